@@ -18,6 +18,7 @@ GWindow::GWindow(int width, int height) {
     fClick = NULL;
     fWidth = width;
     fHeight = height;
+    fFullUpload = true;
 
     this->setupBitmap(width, height);
     fCanvas = GCreateCanvas(fBitmap);
@@ -84,6 +85,7 @@ bool GWindow::handleEvent(const SDL_Event& evt) {
                     this->setupBitmap(fWidth, fHeight);
                     fCanvas = GCreateCanvas(fBitmap);
                     fNeedDraw = true;
+                    fFullUpload = true;     // the new texture's contents are undefined
                     return true;
             }
             break;
@@ -176,7 +178,19 @@ int GWindow::run() {
         if (fNeedDraw) {
             fNeedDraw = false;  // clear this before we call onDraw
             this->onUpdate(fBitmap, fCanvas.get());
-            SDL_UpdateTexture(fTexture, nullptr, fBitmap.pixels(), fBitmap.rowBytes());
+
+            // only upload what the draw touched, once the texture has all of the bitmap
+            GIRect dirty = fCanvas->dirtyBounds();
+            if (fFullUpload) {
+                dirty = GIRect::WH(fBitmap.width(), fBitmap.height());
+                fFullUpload = false;
+            }
+            if (!dirty.isEmpty()) {
+                SDL_Rect r = make(dirty);
+                SDL_UpdateTexture(fTexture, &r, fBitmap.getAddr(dirty.left, dirty.top),
+                                  fBitmap.rowBytes());
+                fCanvas->resetDirty();
+            }
         }
         SDL_RenderCopy(fRenderer, fTexture, nullptr, nullptr);
         this->onDrawOverlays();
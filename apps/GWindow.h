@@ -47,6 +47,7 @@ private:
     int fWidth;
     int fHeight;
     bool fNeedDraw;
+    bool fFullUpload;   // the texture is new, so upload all of the bitmap, not just what's dirty
 
     SDL_Window*   fWindow;
     SDL_Renderer* fRenderer;
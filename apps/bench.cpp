@@ -5,18 +5,38 @@
 #include "bench.h"
 #include "../include/GCanvas.h"
 #include "../include/GBitmap.h"
-#include "../include/GTime.h"
+#include "../include/GInstrument.h"
+#include "../include/GSurfacePool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <memory>
 #include <string>
 #include <vector>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 constexpr double gMaxBenchMultiplier = 32;   // times slower than mine
 
-static void setup_bitmap(GBitmap* bitmap, int w, int h) {
-    size_t rb = w * sizeof(GPixel);
-    bitmap->reset(w, h, rb, (GPixel*)calloc(h, rb), GBitmap::kNo_IsOpaque);
+// Each sample draws enough times to take about this long, so the clock's resolution and the
+// loop's overhead are lost in it, however quick one draw is.
+constexpr double gTargetSampleNanos = 2e6;
+
+static double now_nanos() {
+    using namespace std::chrono;
+    return (double)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static long minor_faults() {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) ? 0 : usage.ru_minflt;
 }
 
 enum Mode {
@@ -25,35 +45,297 @@ enum Mode {
     kOnce,
 };
 
-static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap, Mode mode) {
+enum Counter {
+    kCycles,
+    kInstructions,
+    kL1Misses,      // L1 data cache read misses
+    kLLCMisses,
+    kBranchMisses,
+    kCounterCount,
+};
+
+/**
+ *  Hardware counters (Linux perf_event_open) for this thread, counting user space only. Counters
+ *  the kernel won't open -- no PMU in a VM, perf_event_paranoid, another OS -- are left out, and
+ *  read back as unavailable.
+ */
+class PerfCounters {
+public:
+    PerfCounters() {
+#ifdef __linux__
+        const struct { uint32_t type; uint64_t config; } kEvents[kCounterCount] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        };
+        for (int i = 0; i < kCounterCount; ++i) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = kEvents[i].type;
+            attr.config = kEvents[i].config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // to scale the count up if the PMU had to share the counter with others
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fFds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+        for (int fd : fFds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool any() const {
+        return std::any_of(fFds, fFds + kCounterCount, [](int fd) { return fd >= 0; });
+    }
+
+    void start() {
+#ifdef __linux__
+        for (int fd : fFds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    /**
+     *  Stop counting and return the counts since start() in values[], with -1 for any counter
+     *  that is unavailable (or never got to run).
+     */
+    void stop(double values[kCounterCount]) {
+        for (int i = 0; i < kCounterCount; ++i) {
+            values[i] = -1;
+#ifdef __linux__
+            if (fFds[i] < 0) {
+                continue;
+            }
+            ioctl(fFds[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t data[3];   // value, time enabled, time running
+            if (read(fFds[i], data, sizeof(data)) == sizeof(data) && data[2] > 0) {
+                values[i] = (double)data[0] * data[1] / data[2];
+            }
+#endif
+        }
+    }
+
+private:
+    int fFds[kCounterCount] = { -1, -1, -1, -1, -1 };
+};
+
+struct BenchOptions {
+    Mode    fMode = kNormal;
+#ifdef NDEBUG
+    int     fSamples = 15;
+    int     fWarmup = 3;    // draws, before sampling
+#else
+    int     fSamples = 1;
+    int     fWarmup = 0;
+#endif
+    PerfCounters* fCounters = nullptr;  // counts the sampled draws, if set
+};
+
+struct BenchResult {
+    int     fSamples = 0;
+    int     fReps = 0;      // draws per sample
+    // msec per draw, over the samples
+    double  fMedian = 0;
+    double  fP95 = 0;
+    double  fMean = 0;
+    double  fStdDev = 0;
+    double  fMin = 0;
+    double  fFaults = 0;    // minor page faults per draw
+    double  fCounts[kCounterCount] = { -1, -1, -1, -1, -1 };    // per draw, -1 if unavailable
+};
+
+// Fills in the statistics of the samples (msec per draw), sorting them.
+static void summarize(std::vector<double>& samples, BenchResult* result) {
+    std::sort(samples.begin(), samples.end());
+    int n = (int)samples.size();
+    double sum = 0;
+    for (double s : samples) {
+        sum += s;
+    }
+    double mean = sum / n;
+    double var = 0;
+    for (double s : samples) {
+        var += (s - mean) * (s - mean);
+    }
+
+    result->fSamples = n;
+    result->fMedian = n & 1 ? samples[n/2] : (samples[n/2 - 1] + samples[n/2]) / 2;
+    result->fP95 = samples[std::min(n - 1, (int)std::ceil(0.95 * n) - 1)];   // nearest rank
+    result->fMean = mean;
+    result->fStdDev = n > 1 ? std::sqrt(var / (n - 1)) : 0;
+    result->fMin = samples[0];
+}
+
+static BenchResult handle_proc(GBenchmark* bench, GSurfacePool* pool, GOwnedBitmap* bitmap,
+                               const BenchOptions& options) {
     GISize size = bench->size();
-    setup_bitmap(bitmap, size.width, size.height);
+    *bitmap = pool->alloc(size.width, size.height);
 
-    auto canvas = GCreateCanvas(*bitmap);
+    auto canvas = GCreateCanvas(**bitmap);
     if (!canvas) {
         fprintf(stderr, "failed to create canvas for [%d %d] %s\n",
                 size.width, size.height, bench->name());
-        return 0;
+        return BenchResult();
     }
 
-#ifdef NDEBUG
-    int N = 100;
+    if (options.fMode == kForever) {
+        for (;;) {
+            bench->draw(canvas.get());
+        }
+    }
+
+    // the warmup draws also size the samples; --once just draws a few times, unsized
+    int reps = options.fMode == kOnce ? 4 : 1;
+    if (options.fWarmup > 0 && options.fMode != kOnce) {
+        double start = now_nanos();
+        for (int i = 0; i < options.fWarmup; ++i) {
+            bench->draw(canvas.get());
+        }
+        double perDraw = std::max(1.0, (now_nanos() - start) / options.fWarmup);
+        reps = (int)std::min(1e6, std::ceil(gTargetSampleNanos / perDraw));
+    }
+    int sampleCount = options.fMode == kOnce ? 1 : options.fSamples;
+
+    std::vector<double> samples(sampleCount);
+    double counts[kCounterCount];
+    if (options.fCounters) {
+        options.fCounters->start();
+    }
+    long faults = minor_faults();
+    for (int s = 0; s < sampleCount; ++s) {
+        double start = now_nanos();
+        for (int i = 0; i < reps; ++i) {
+            bench->draw(canvas.get());
+        }
+        samples[s] = (now_nanos() - start) * 1e-6 / reps;
+    }
+    faults = minor_faults() - faults;
+    if (options.fCounters) {
+        options.fCounters->stop(counts);
+    }
+
+    BenchResult result;
+    summarize(samples, &result);
+    result.fReps = reps;
+    result.fFaults = faults * 1.0 / (sampleCount * reps);
+    for (int i = 0; options.fCounters && i < kCounterCount; ++i) {
+        result.fCounts[i] = counts[i] < 0 ? -1 : counts[i] / (sampleCount * reps);
+    }
+    return result;
+}
+
+// Runs the benches on just this cpu, so they aren't migrated mid-sample.
+static bool pin_to_cpu(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
 #else
-    int N = 1;
+    return false;
 #endif
-    bool forever = false;
-    switch (mode) {
-        case kNormal: break;
-        case kForever: forever = true; break;
-        case kOnce: N = 4; break;
+}
+
+// What the counters say about a bench, derived per draw: instructions per cycle, and misses per
+// pixel of its device (so benches of different sizes compare). Each is -1 if a counter it needs
+// is unavailable.
+struct CounterStats {
+    double fIPC, fL1PerPixel, fLLCPerPixel, fBranchPerPixel;
+
+    CounterStats(const BenchResult& r, GISize size) {
+        const double* c = r.fCounts;
+        double pixels = std::max(1.0, (double)size.width * size.height);
+        auto perPixel = [pixels](double count) { return count < 0 ? -1 : count / pixels; };
+        fIPC = c[kCycles] > 0 && c[kInstructions] >= 0 ? c[kInstructions] / c[kCycles] : -1;
+        fL1PerPixel = perPixel(c[kL1Misses]);
+        fLLCPerPixel = perPixel(c[kLLCMisses]);
+        fBranchPerPixel = perPixel(c[kBranchMisses]);
+    }
+};
+
+static void print_stat(FILE* f, const char format[], double value, const char missing[]) {
+    if (value < 0) {
+        fprintf(f, "%s", missing);
+    } else {
+        fprintf(f, format, value);
+    }
+}
+
+struct BenchRow {
+    std::string fName;
+    GISize      fSize;
+    BenchResult fResult;
+};
+
+// With counters, each row adds the CounterStats, empty where unavailable.
+static bool write_csv(const char filename[], const std::vector<BenchRow>& rows, bool counters) {
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "name,samples,reps,median_ms,p95_ms,mean_ms,stddev_ms,min_ms,faults%s\n",
+            counters ? ",ipc,l1_miss_per_px,llc_miss_per_px,branch_miss_per_px" : "");
+    for (const BenchRow& row : rows) {
+        const BenchResult& r = row.fResult;
+        fprintf(f, "%s,%d,%d,%.6g,%.6g,%.6g,%.6g,%.6g,%g", row.fName.c_str(), r.fSamples,
+                r.fReps, r.fMedian, r.fP95, r.fMean, r.fStdDev, r.fMin, r.fFaults);
+        if (counters) {
+            CounterStats stats(r, row.fSize);
+            for (double value : { stats.fIPC, stats.fL1PerPixel, stats.fLLCPerPixel,
+                                  stats.fBranchPerPixel }) {
+                print_stat(f, ",%.6g", value, ",");
+            }
+        }
+        fprintf(f, "\n");
     }
+    return fclose(f) == 0;
+}
 
-    GMSec now = GTime::GetMSec();
-    for (int i = 0; i < N || forever; ++i) {
-        bench->draw(canvas.get());
+// With counters, each bench adds the CounterStats, null where unavailable.
+static bool write_json(const char filename[], const std::vector<BenchRow>& rows, bool counters) {
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "{\"benches\": [");
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const BenchResult& r = rows[i].fResult;
+        fprintf(f, "%s\n  {\"name\": \"%s\", \"samples\": %d, \"reps\": %d, "
+                   "\"median_ms\": %.6g, \"p95_ms\": %.6g, \"mean_ms\": %.6g, "
+                   "\"stddev_ms\": %.6g, \"min_ms\": %.6g, \"faults\": %g",
+                i ? "," : "", rows[i].fName.c_str(), r.fSamples, r.fReps, r.fMedian, r.fP95,
+                r.fMean, r.fStdDev, r.fMin, r.fFaults);
+        if (counters) {
+            CounterStats stats(r, rows[i].fSize);
+            const char* names[] = { "ipc", "l1_miss_per_px", "llc_miss_per_px",
+                                    "branch_miss_per_px" };
+            const double values[] = { stats.fIPC, stats.fL1PerPixel, stats.fLLCPerPixel,
+                                      stats.fBranchPerPixel };
+            for (int j = 0; j < 4; ++j) {
+                fprintf(f, ", \"%s\": ", names[j]);
+                print_stat(f, "%.6g", values[j], "null");
+            }
+        }
+        fprintf(f, "}");
     }
-    GMSec dur = GTime::GetMSec() - now;
-    return dur * 1.0 / N;
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
 }
 
 static bool is_arg(const char arg[], const char name[]) {
@@ -70,6 +352,33 @@ static bool is_arg(const char arg[], const char name[]) {
     return !strcmp(arg, shortVers);
 }
 
+// For the flags whose first letter is already another flag's short form: only --name matches.
+static bool is_long_arg(const char arg[], const char name[]) {
+    return arg[0] == '-' && arg[1] == '-' && !strcmp(arg + 2, name);
+}
+
+// Draws the bench once more as its own frame and writes that frame's counters to <name>.json
+// and its draw calls to <name>.trace.json.
+static bool write_instrumented(GBenchmark* bench, const GBitmap& bitmap) {
+    auto canvas = GCreateCanvas(bitmap);
+    GInstrument::BeginFrame();
+    bench->draw(canvas.get());
+
+    bool ok = true;
+    const char* suffixes[] = { ".json", ".trace.json" };
+    for (int i = 0; i < 2; ++i) {
+        std::string path = std::string(bench->name()) + suffixes[i];
+        FILE* f = fopen(path.c_str(), "w");
+        if (!f) {
+            printf("FAILED TO OPEN %s\n", path.c_str());
+            return false;
+        }
+        ok &= i == 0 ? GInstrument::WriteJSON(f) : GInstrument::WriteTrace(f);
+        ok &= fclose(f) == 0;
+    }
+    return ok;
+}
+
 static std::vector<double> load_scores(const char filename[], int count) {
     std::vector<double> scores;
     FILE* f = fopen(filename, "r");
@@ -87,24 +396,30 @@ static std::vector<double> load_scores(const char filename[], int count) {
 }
 
 int main_bench(int argc, const char* argv[]) {
-    Mode mode = kNormal;
+    BenchOptions options;
     const char* match = nullptr;
     const char* scoreFile = nullptr;
     const char* outScores = nullptr;
     std::vector<double> inScores;
     bool chatty_mode = true;
     bool write_images = false;
+    bool show_faults = false;
+    bool instrument = false;
+    int pin = -1;
+    const char* csvFile = nullptr;
+    const char* jsonFile = nullptr;
+    bool counters = false;
 
     int count = -1;
     while (gBenchFactories[++count]);
 
     for (int i = 1; i < argc; ++i) {
         if (is_arg(argv[i], "once")) {
-            mode = kOnce;
+            options.fMode = kOnce;
         } else if (is_arg(argv[i], "match") && i+1 < argc) {
             match = argv[++i];
         } else if (is_arg(argv[i], "forever")) {
-            mode = kForever;
+            options.fMode = kForever;
         } else if (is_arg(argv[i], "scoreFile") && i+1 < argc) {
             scoreFile = argv[++i];
         } else if (is_arg(argv[i], "outScores") && i+1 < argc) {
@@ -118,18 +433,58 @@ int main_bench(int argc, const char* argv[]) {
             chatty_mode = false;
         } else if (is_arg(argv[i], "writeImages")) {
             write_images = true;
+        } else if (is_arg(argv[i], "pageFaults")) {
+            show_faults = true;
+        } else if (is_long_arg(argv[i], "instrument")) {
+            instrument = true;
+        } else if (is_long_arg(argv[i], "samples") && i+1 < argc) {
+            options.fSamples = std::max(1, atoi(argv[++i]));
+        } else if (is_long_arg(argv[i], "warmup") && i+1 < argc) {
+            options.fWarmup = std::max(0, atoi(argv[++i]));
+        } else if (is_long_arg(argv[i], "pin") && i+1 < argc) {
+            pin = atoi(argv[++i]);
+        } else if (is_long_arg(argv[i], "csv") && i+1 < argc) {
+            csvFile = argv[++i];
+        } else if (is_long_arg(argv[i], "json") && i+1 < argc) {
+            jsonFile = argv[++i];
+        } else if (is_long_arg(argv[i], "counters")) {
+            counters = true;
         } else {
             printf("Unknown arg %s\n", argv[i]);
             return -1;
         }
     }
 
+    if (instrument && !GInstrument::kEnabled) {
+        printf("--instrument needs a build with -DG_INSTRUMENT (make ibench)\n");
+        return -1;
+    }
+
     if (scoreFile && inScores.size() == 0) {
         printf("Can't compute --scoreFile without --inScores\n");
         return -1;
     }
 
+    if (pin >= 0 && !pin_to_cpu(pin)) {
+        printf("FAILED TO PIN TO CPU %d, running unpinned\n", pin);
+    }
+
+    // opened after pinning, so they count on that cpu
+    std::unique_ptr<PerfCounters> perf;
+    if (counters) {
+        perf.reset(new PerfCounters);
+        if (perf->any()) {
+            options.fCounters = perf.get();
+        } else {
+            printf("hardware counters unavailable (perf_event_open), timing only\n");
+        }
+    }
+
+    // every bench's device comes from here, so same-sized benches reuse one allocation
+    GSurfacePool surfaces;
+
     std::vector<double> durs;
+    std::vector<BenchRow> rows;
     double quotient = 0;
     for (int i = 0; i < count; ++i) {
         std::unique_ptr<GBenchmark> bench(gBenchFactories[i]());
@@ -139,10 +494,29 @@ int main_bench(int argc, const char* argv[]) {
             continue;
         }
 
-        GBitmap testBM;
-        double dur = handle_proc(bench.get(), name, &testBM, mode);
+        GOwnedBitmap testBM;
+        BenchResult result = handle_proc(bench.get(), &surfaces, &testBM, options);
+        double dur = result.fMedian;
         if (chatty_mode) {
             printf("%s %g", name, dur);
+            if (result.fSamples > 1) {
+                printf(" p95 %g sd %.1f%%", result.fP95,
+                       result.fMean > 0 ? 100 * result.fStdDev / result.fMean : 0);
+            }
+            if (options.fCounters) {
+                CounterStats stats(result, bench->size());
+                printf(" ipc ");
+                print_stat(stdout, "%.2f", stats.fIPC, "-");
+                printf(" l1/px ");
+                print_stat(stdout, "%.3g", stats.fL1PerPixel, "-");
+                printf(" llc/px ");
+                print_stat(stdout, "%.3g", stats.fLLCPerPixel, "-");
+                printf(" br/px ");
+                print_stat(stdout, "%.3g", stats.fBranchPerPixel, "-");
+            }
+            if (show_faults) {
+                printf(" faults %g", result.fFaults);
+            }
         }
         if (inScores.size()) {
             double quo = std::min(dur / inScores[i], gMaxBenchMultiplier);
@@ -155,13 +529,16 @@ int main_bench(int argc, const char* argv[]) {
             printf("\n");
         }
         durs.push_back(dur);
+        rows.push_back({ name, bench->size(), result });
 
         if (write_images) {
             std::string str(name);
             str += ".png";
-            testBM.writeToFile(str.c_str());
+            testBM->writeToFile(str.c_str());
+        }
+        if (instrument && !write_instrumented(bench.get(), *testBM)) {
+            return -1;
         }
-        free(testBM.pixels());
     }
 
     if (inScores.size()) {
@@ -178,6 +555,15 @@ int main_bench(int argc, const char* argv[]) {
         }
     }
 
+    if (csvFile && !write_csv(csvFile, rows, options.fCounters)) {
+        printf("FAILED TO WRITE TO %s\n", csvFile);
+        return -1;
+    }
+    if (jsonFile && !write_json(jsonFile, rows, options.fCounters)) {
+        printf("FAILED TO WRITE TO %s\n", jsonFile);
+        return -1;
+    }
+
     if (durs.size() > 0 && outScores != nullptr) {
         FILE* f = fopen(outScores, "w");
         if (f) {
@@ -16,6 +16,7 @@
 #include "bench_pa4.inc"
 #include "bench_pa5.inc"
 #include "bench_pa6.inc"
+#include "bench_perf.inc"
 
 const GBenchmark::Factory gBenchFactories[] {
     []() -> GBenchmark* { return new ClearBench(); },
@@ -102,5 +103,55 @@ const GBenchmark::Factory gBenchFactories[] {
         return new QuadBench(colors, texs, "quad_mesh");
     },
 
+    // perf
+    []() -> GBenchmark* {
+        return new StrokeBench("stroke_thin", 1, GStroke::kMiter_Join, GStroke::kButt_Cap);
+    },
+    []() -> GBenchmark* {
+        return new StrokeBench("stroke_thick", 8, GStroke::kRound_Join, GStroke::kRound_Cap);
+    },
+    []() -> GBenchmark* {
+        return new StrokeBench("stroke_dash", 2, GStroke::kBevel_Join, GStroke::kSquare_Cap,
+                               {6, 4});
+    },
+    []() -> GBenchmark* { return new HairlineBench("lines_poly",  HairlineBench::kPolygon);  },
+    []() -> GBenchmark* { return new HairlineBench("hairlines",   HairlineBench::kHairline);   },
+    []() -> GBenchmark* { return new HairlineBench("hairlines_aa", HairlineBench::kHairlineAA); },
+    []() -> GBenchmark* { return new ScrollBench("scroll_rect_clip", false); },
+    []() -> GBenchmark* { return new ScrollBench("scroll_path_clip", true);  },
+    []() -> GBenchmark* { return new MapBench("map_scene"); },
+    []() -> GBenchmark* { return new LayerBench("layers_nested"); },
+    []() -> GBenchmark* { return new OffscreenBench("offscreen_malloc", false); },
+    []() -> GBenchmark* { return new OffscreenBench("offscreen_pooled", true);  },
+    []() -> GBenchmark* { return new ColumnsBench("columns_1024_tight",  1024, false); },
+    []() -> GBenchmark* { return new ColumnsBench("columns_1024_padded", 1024, true);  },
+    []() -> GBenchmark* { return new ColumnsBench("columns_2048_tight",  2048, false); },
+    []() -> GBenchmark* { return new ColumnsBench("columns_2048_padded", 2048, true);  },
+    []() -> GBenchmark* { return new DragBench("drag_full",  false); },
+    []() -> GBenchmark* { return new DragBench("drag_dirty", true);  },
+    []() -> GBenchmark* { return new RectsOverBench("rects_blend_opaque_dst", 1);     },
+    []() -> GBenchmark* { return new RectsOverBench("rects_blend_alpha_dst",  0.99f); },
+    []() -> GBenchmark* { return new RectsBatchBench("rects_blend_each",     false, false); },
+    []() -> GBenchmark* { return new RectsBatchBench("rects_blend_batched",  false, true);  },
+    []() -> GBenchmark* { return new RectsBatchBench("rects_opaque_each",    true,  false); },
+    []() -> GBenchmark* { return new RectsBatchBench("rects_opaque_batched", true,  true);  },
+    []() -> GBenchmark* { return new MapPointsBench("map_identity",  GMatrix()); },
+    []() -> GBenchmark* { return new MapPointsBench("map_translate", GMatrix::Translate(3, 4)); },
+    []() -> GBenchmark* {
+        return new MapPointsBench("map_scale", GMatrix(1.5f, 0, 3, 0, 2.5f, 4));
+    },
+    []() -> GBenchmark* { return new MapPointsBench("map_affine", GMatrix::Rotate(0.5f)); },
+    []() -> GBenchmark* { return new BitmapOffsetBench("bitmap_offset_int",  -20);      },
+    []() -> GBenchmark* { return new BitmapOffsetBench("bitmap_offset_frac", -20.25f); },
+    []() -> GBenchmark* { return new SaveTreeBench(); },
+    []() -> GBenchmark* { return new EncodeBench("encode_store",   GPNGOptions::kStore);   },
+    []() -> GBenchmark* { return new EncodeBench("encode_rle",     GPNGOptions::kRLE);     },
+    []() -> GBenchmark* { return new EncodeBench("encode_fast",    GPNGOptions::kFast);    },
+    []() -> GBenchmark* { return new EncodeBench("encode_default", GPNGOptions::kDefault); },
+    []() -> GBenchmark* { return new EncodeThreadsBench("encode_4k_1", 1); },
+    []() -> GBenchmark* { return new EncodeThreadsBench("encode_4k_4", 4); },
+    []() -> GBenchmark* { return new LoadBench("load_png", false); },
+    []() -> GBenchmark* { return new LoadBench("load_mapped", true); },
+
     nullptr,
 };
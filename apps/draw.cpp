@@ -10,6 +10,7 @@
 #include "../include/GRandom.h"
 #include "../include/GRect.h"
 #include "../include/GShader.h"
+#include "../include/GStroke.h"
 
 #include <vector>
 
@@ -88,13 +89,13 @@ static void draw_point(GCanvas* canvas, GPoint p) {
 }
 
 static void draw_line(GCanvas* canvas, GPoint p0, GPoint p1, GColor c, float width) {
-    GVector norm = { p1.y - p0.y, p0.x - p1.x };
-    float scale = width / 2 / norm.length();
-    norm.x *= scale;
-    norm.y *= scale;
+    GPath path;
+    path.moveTo(p0);
+    path.lineTo(p1);
 
-    GPoint quad[4] = { p0 + norm, p1 + norm, p1 - norm, p0 - norm };
-    canvas->drawConvexPolygon(quad, 4, GPaint(c));
+    GStroke stroke;
+    stroke.fWidth = width;
+    canvas->drawPath(GStrokePath(path, stroke), GPaint(c));
 }
 
 static GRect make_rect(GPoint a, GPoint b) {
@@ -105,15 +106,13 @@ static GRect make_rect(GPoint a, GPoint b) {
 }
 
 static void stroke_rect(GCanvas* canvas, const GRect& r, GColor c, float width) {
-    auto inset = [](const GRect& r, float dx, float dy) {
-        return GRect::LTRB(
-               r.left + dx, r.top + dy, r.right - dx, r.bottom - dy);
-    };
     GPath path;
-    const float radius = width * 0.5f;
-    path.addRect(inset(r,  radius,  radius), GPath::kCW_Direction);
-    path.addRect(inset(r, -radius, -radius), GPath::kCCW_Direction);
-    canvas->drawPath(path, GPaint(c));
+    path.addRect(r);
+
+    GStroke stroke;
+    stroke.fWidth = width;
+    stroke.fClosed = true;
+    canvas->drawPath(GStrokePath(path, stroke), GPaint(c));
 }
 
 class Shape {
@@ -89,22 +89,14 @@ class MeshShape : public Shape {
 
     }
 
-    static void draw_line(GCanvas* canvas, GPoint a, GPoint b, const GPaint& paint) {
-        GVector v = b - a;
-        float scale = 1.0f / v.length();
+    static void draw_poly_line(GCanvas* canvas, const GPoint pts[], int count, const GPaint& paint) {
         GPath path;
-        v = { v.y * scale, -v.x * scale };
+        path.addPolygon(pts, count);
 
-        path.moveTo(a + v);
-        path.lineTo(b + v);
-        path.lineTo(b - v);
-        path.lineTo(a - v);
-        canvas->drawPath(path, paint);
-    }
-    static void draw_poly_line(GCanvas* canvas, const GPoint pts[], int count, const GPaint& paint) {
-        for (int i = 0; i < count - 1; ++i) {
-            draw_line(canvas, pts[i], pts[i+1], paint);
-        }
+        GStroke stroke;
+        stroke.fWidth = 2;
+        stroke.fJoin = GStroke::kRound_Join;
+        canvas->drawPath(GStrokePath(path, stroke), paint);
     }
 
     static float lerp(float a, float b, float t) {
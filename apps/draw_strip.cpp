@@ -5,6 +5,7 @@
 #include "../include/GPoint.h"
 #include "../include/GMatrix.h"
 #include "../include/GCanvas.h"
+#include "../include/GStroke.h"
 #include <vector>
 
 template <typename T> T lerp(T a, T b, float t) {
@@ -33,38 +34,25 @@ static void compute_pos_tan(const GPoint pts[4], float t, GPoint* pos, GPoint* t
     }
 }
 
-static void add_line(GPath* path, GPoint a, GPoint b, float width) {
-    const float radius = width * 0.5f;
-    auto vec = b - a;
-    vec = vec * (radius / vec.length());
-    GPoint norm = {vec.y, -vec.x};
-    path->moveTo(a + norm);
-    path->lineTo(b + norm);
-    path->lineTo(b - norm);
-    path->lineTo(a - norm);
-}
-
 static void frame_line(GCanvas* canvas, GPoint a, GPoint b, const GPaint& paint, float width) {
     GPath path;
-    add_line(&path, a, b, width);
-    canvas->drawPath(path, paint);
+    path.moveTo(a);
+    path.lineTo(b);
+
+    GStroke stroke;
+    stroke.fWidth = width;
+    canvas->drawPath(GStrokePath(path, stroke), paint);
 }
 
 static void draw_mesh_frame(GCanvas* canvas, const GPoint verts[], const int indices[], int nTris) {
-    GPaint paint;
-    const float w = 1.5f;
-    auto frame_triangle = [&](GPoint a, GPoint b, GPoint c) {
-        GPath path;
-        add_line(&path, a, b, w);
-        add_line(&path, b, c, w);
-        add_line(&path, c, a, w);
-        canvas->drawPath(path, paint);
-    };
+    std::vector<GPoint> lines;
     for (int i = 0; i < nTris; ++i) {
-        frame_triangle(verts[indices[i*3 + 0]],
-                       verts[indices[i*3 + 1]],
-                       verts[indices[i*3 + 2]]);
+        GPoint a = verts[indices[i*3 + 0]];
+        GPoint b = verts[indices[i*3 + 1]];
+        GPoint c = verts[indices[i*3 + 2]];
+        lines.insert(lines.end(), { a, b, b, c, c, a });
     }
+    canvas->drawHairlines(lines.data(), nTris * 3, GPaint(), true);
 }
 
 static void draw_mesh_quads(GCanvas* canvas, const GPoint verts[], int nQuads) {
@@ -6,6 +6,7 @@
 #include "../include/GCanvas.h"
 #include "../include/GColor.h"
 #include "../include/GBitmap.h"
+#include "../include/GSurfacePool.h"
 #include <string>
 
 static int pixel_diff(GPixel p0, GPixel p1) {
@@ -57,10 +58,12 @@ static double compare(const GBitmap& a, const GBitmap& b, int tolerance, bool ve
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
-static void handle_proc(const GDrawRec& rec, const char path[], GBitmap* bitmap) {
-    bitmap->alloc(rec.fWidth, rec.fHeight);
+static void handle_proc(const GDrawRec& rec, const char path[], GSurfacePool* pool,
+                        GOwnedBitmap* bitmap) {
+    // the canvas clears it below, so recycled pixels needn't be zeroed first
+    *bitmap = pool->alloc(rec.fWidth, rec.fHeight, false);
 
-    auto canvas = GCreateCanvas(*bitmap);
+    auto canvas = GCreateCanvas(**bitmap);
     if (!canvas) {
         fprintf(stderr, "failed to create canvas for [%d %d] %s\n",
                 rec.fWidth, rec.fHeight, rec.fName);
@@ -70,7 +73,7 @@ static void handle_proc(const GDrawRec& rec, const char path[], GBitmap* bitmap)
     canvas->clear({0, 0, 0, 0});
     rec.fDraw(canvas.get());
 
-    if (!bitmap->writeToFile(path)) {
+    if (!(*bitmap)->writeToFile(path)) {
         fprintf(stderr, "failed to write %s\n", path);
     }
 }
@@ -257,6 +260,9 @@ int main_image(int argc, const char* argv[]) {
     // pa#_NAME.png -- so add 8 to the name length for the total
     const int maxNameLen = max_name_len() + 8;
 
+    // most records share a few sizes, so their bitmaps are recycled rather than reallocated
+    GSurfacePool surfaces;
+
     double percent_correct = 0;
     double counter = 0;
     for (int i = 0; gDrawRecs[i].fDraw; ++i) {
@@ -284,8 +290,8 @@ int main_image(int argc, const char* argv[]) {
             printf("image: [%2d] %*s", i, maxNameLen, path.c_str());
         }
         
-        GBitmap testBM;
-        handle_proc(gDrawRecs[i], path.c_str(), &testBM);
+        GOwnedBitmap testBM;
+        handle_proc(gDrawRecs[i], path.c_str(), &surfaces, &testBM);
 
         if (expected && !something) {
             std::string exp_path(expected);
@@ -297,9 +303,9 @@ int main_image(int argc, const char* argv[]) {
             if (!expectedBM.readFromFile(exp_path.c_str())) {
                 printf("- failed to load <%s>", exp_path.c_str());
             } else {
-                double correct = compare(testBM, expectedBM, tolerance, verbose);
+                double correct = compare(*testBM, expectedBM, tolerance, verbose);
                 if (correct < 1 && diffFile != NULL) {
-                    add_diff_to_file(diffFile, testBM, expectedBM, diffDir, gDrawRecs[i].fName);
+                    add_diff_to_file(diffFile, *testBM, expectedBM, diffDir, gDrawRecs[i].fName);
                 }
                 double individual_score = correct * weight;
 
@@ -310,8 +316,6 @@ int main_image(int argc, const char* argv[]) {
         if (verbose && !something) {
             printf("\n");
         }
-
-        free(testBM.pixels());
     }
     if (diffFile) {
         fclose(diffFile);
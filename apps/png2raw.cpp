@@ -0,0 +1,40 @@
+/**
+ *  Copyright 2024 Gordon Kim
+ */
+
+#include "../include/GMappedBitmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+// Converts each PNG named on the command line to a raw image (see GMappedBitmap) beside it,
+// with the extension replaced: apps/spock.png -> apps/spock.graw
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        printf("usage: %s file.png ...\n", argv[0]);
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string dst(argv[i]);
+        size_t dot = dst.rfind('.');
+        if (dot != std::string::npos && dst.find('/', dot) == std::string::npos) {
+            dst.erase(dot);
+        }
+        dst += ".graw";
+
+        GBitmap bm;
+        if (!bm.readFromFile(argv[i])) {
+            printf("failed to read %s\n", argv[i]);
+            failures += 1;
+            continue;
+        }
+        if (!GMappedBitmap::Write(bm, dst.c_str())) {
+            printf("failed to write %s\n", dst.c_str());
+            failures += 1;
+        }
+        free(bm.pixels());
+    }
+    return failures ? 1 : 0;
+}
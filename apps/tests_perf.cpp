@@ -0,0 +1,1062 @@
+/**
+ *  Copyright 2024 Gordon Kim
+ */
+
+#include "../include/GCanvas.h"
+#include "../include/GBitmap.h"
+#include "../include/GInstrument.h"
+#include "../include/GMappedBitmap.h"
+#include "../include/GPath.h"
+#include "../include/GRandom.h"
+#include "../include/GShader.h"
+#include "../include/GStroke.h"
+#include "../src/GPNGWriter.h"
+#include "../src/GPathPriv.h"
+#include "../src/lodepng.h"
+#include "tests.h"
+#include <cstdio>
+#include <unistd.h>
+
+static bool same_pixels(const GBitmap& a, const GBitmap& b) {
+    if (a.width() != b.width() || a.height() != b.height()) {
+        return false;
+    }
+    for (int y = 0; y < a.height(); ++y) {
+        if (memcmp(a.getAddr(0, y), b.getAddr(0, y), a.width() * sizeof(GPixel))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void make_curvy_path(GPath* path) {
+    path->moveTo(10, 10);
+    path->quadTo(60, 0, 50, 40);
+    path->cubicTo(40, 60, 20, 0, 5, 45);
+    path->lineTo(30, 20);
+}
+
+static void test_path_flat_cache(GTestStats* stats) {
+    GPath cached;
+    make_curvy_path(&cached);
+
+    const GMatrix mxs[] = {
+        GMatrix::Scale(1.5f, 1.5f),
+        GMatrix::Translate(7, 3) * GMatrix::Scale(1.5f, 1.5f),   // same scale: reuses the cache
+        GMatrix::Rotate(0.3f),
+    };
+
+    for (const GMatrix& mx : mxs) {
+        GPath fresh;    // drawn once, so never hits its cache
+        make_curvy_path(&fresh);
+
+        GBitmap a, b;
+        a.alloc(100, 100);
+        b.alloc(100, 100);
+        auto ca = GCreateCanvas(a);
+        auto cb = GCreateCanvas(b);
+        ca->concat(mx);
+        cb->concat(mx);
+        ca->drawPath(cached, GPaint());
+        cb->drawPath(fresh, GPaint());
+        EXPECT_TRUE(stats, same_pixels(a, b));
+        EXPECT_NULL(stats, GPathPriv::FlatCache(fresh));
+        free(a.pixels());
+        free(b.pixels());
+    }
+    // cached on its second draw under the 1.5 scale
+    EXPECT_PTR(stats, GPathPriv::FlatCache(cached));
+
+    GPath temp;
+    make_curvy_path(&temp);
+    temp.setIsVolatile(true);
+    {
+        GBitmap a;
+        a.alloc(100, 100);
+        auto canvas = GCreateCanvas(a);
+        canvas->drawPath(temp, GPaint());
+        canvas->drawPath(temp, GPaint());
+        free(a.pixels());
+    }
+    EXPECT_NULL(stats, GPathPriv::FlatCache(temp));
+
+    cached.lineTo(90, 90);
+    EXPECT_NULL(stats, GPathPriv::FlatCache(cached));
+}
+
+static bool same_pixels_at(const GBitmap& small, const GBitmap& big, int dx, int dy) {
+    for (int y = 0; y < small.height(); ++y) {
+        if (memcmp(small.getAddr(0, y), big.getAddr(dx, y + dy), small.width() * sizeof(GPixel))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Curves that fall entirely outside the device are culled, but must still contribute their
+// winding to the visible part of the path.
+static void test_path_cull(GTestStats* stats) {
+    GPath path;
+    path.addCircle({60, 50}, 45);
+    path.moveTo(5, 5);
+    path.cubicTo(-40, 30, 0, 60, 8, 95);
+    path.quadTo(140, 100, 120, 5);
+
+    for (bool isVolatile : { false, true }) {
+        path.setIsVolatile(isVolatile);
+
+        GBitmap small, big;
+        small.alloc(50, 60);
+        big.alloc(200, 120);
+        auto cs = GCreateCanvas(small);
+        auto cb = GCreateCanvas(big);
+        cs->translate(-50, -20);
+        cs->drawPath(path, GPaint());
+        cb->drawPath(path, GPaint());
+        EXPECT_TRUE(stats, same_pixels_at(small, big, 50, 20));
+        free(small.pixels());
+        free(big.pixels());
+    }
+}
+
+// drawConvexPolygon must cover exactly the pixels drawPath does for the same polygon.
+static void test_convex_poly(GTestStats* stats) {
+    const struct {
+        int   count;
+        float cx, cy, radius, angle;
+    } recs[] = {
+        {   3, 20, 20, 15, 0.1f },
+        {   4, 30, 25, 40, 0.785f },    // sticks out of every side
+        {   6,  0, 50, 20, 0 },         // flat top and bottom, clipped on the left
+        { 100, 30, 30, 25, 0.3f },      // too many points for the stack storage
+    };
+
+    for (const auto& r : recs) {
+        std::vector<GPoint> pts(r.count);
+        for (int i = 0; i < r.count; ++i) {
+            float a = r.angle + i * gFloatPI * 2 / r.count;
+            pts[i] = { r.cx + r.radius * cosf(a), r.cy + r.radius * sinf(a) };
+        }
+        GPath path;
+        path.addPolygon(pts.data(), r.count);
+
+        GBitmap a, b;
+        a.alloc(60, 60);
+        b.alloc(60, 60);
+        GCreateCanvas(a)->drawConvexPolygon(pts.data(), r.count, GPaint());
+        GCreateCanvas(b)->drawPath(path, GPaint());
+        EXPECT_TRUE(stats, same_pixels(a, b));
+        free(a.pixels());
+        free(b.pixels());
+    }
+}
+
+static bool stroke_matches(const GPath& src, const GStroke& stroke, const GPath& expected) {
+    GBitmap a, b;
+    a.alloc(110, 60);
+    b.alloc(110, 60);
+    GCreateCanvas(a)->drawPath(GStrokePath(src, stroke), GPaint());
+    GCreateCanvas(b)->drawPath(expected, GPaint());
+    bool same = same_pixels(a, b);
+    free(a.pixels());
+    free(b.pixels());
+    return same;
+}
+
+static bool stroke_covers(const GPath& src, const GStroke& stroke, int x, int y) {
+    GBitmap bm;
+    bm.alloc(110, 60);
+    GCreateCanvas(bm)->drawPath(GStrokePath(src, stroke), GPaint());
+    bool covered = *bm.getAddr(x, y) != 0;
+    free(bm.pixels());
+    return covered;
+}
+
+static void test_stroke(GTestStats* stats) {
+    GPath line;
+    line.moveTo(10, 20);
+    line.lineTo(50, 20);
+
+    GStroke stroke;
+    stroke.fWidth = 10;
+    GPath expected;
+    expected.addRect(GRect::LTRB(10, 15, 50, 25));
+    EXPECT_TRUE(stats, stroke_matches(line, stroke, expected));
+
+    stroke.fCap = GStroke::kSquare_Cap;
+    expected.reset();
+    expected.addRect(GRect::LTRB(5, 15, 55, 25));
+    EXPECT_TRUE(stats, stroke_matches(line, stroke, expected));
+
+    // a rect with miter joins is the outer rect minus the inner one
+    GPath rect;
+    rect.addRect(GRect::LTRB(10, 10, 50, 40));
+    stroke = GStroke();
+    stroke.fWidth = 6;
+    stroke.fClosed = true;
+    expected.reset();
+    expected.addRect(GRect::LTRB(7, 7, 53, 43), GPath::kCW_Direction);
+    expected.addRect(GRect::LTRB(13, 13, 47, 37), GPath::kCCW_Direction);
+    EXPECT_TRUE(stats, stroke_matches(rect, stroke, expected));
+
+    // a tighter miter limit bevels the same corners
+    stroke.fMiterLimit = 1.2f;
+    EXPECT_FALSE(stats, stroke_matches(rect, stroke, expected));
+    EXPECT_FALSE(stats, stroke_covers(rect, stroke, 7, 7));
+
+    // dashes walk the contour from the phase
+    GPath longLine;
+    longLine.moveTo(0, 20);
+    longLine.lineTo(100, 20);
+    stroke = GStroke();
+    stroke.fWidth = 4;
+    stroke.fDashes = { 10, 10 };
+    stroke.fDashPhase = 5;
+    expected.reset();
+    expected.addRect(GRect::LTRB(0, 18, 5, 22));
+    for (int x = 15; x < 100; x += 20) {
+        expected.addRect(GRect::LTRB(x, 18, std::min(x + 10, 100), 22));
+    }
+    EXPECT_TRUE(stats, stroke_matches(longLine, stroke, expected));
+
+    // dash patterns that are all zero, or too fine to step through, stroke solid (and finish)
+    expected.reset();
+    expected.addRect(GRect::LTRB(0, 18, 100, 22));
+    for (std::vector<float> dashes : std::vector<std::vector<float>>{
+             { 0, 0 }, { 1e-30f, 1e-30f }, { 0.001f, 0.001f }, { 1e-30f, 0, 1e-30f } }) {
+        stroke.fDashes = dashes;
+        EXPECT_TRUE(stats, stroke_matches(longLine, stroke, expected));
+    }
+
+    // so does a contour that would repeat its pattern too many times to be worth dashing
+    GPath longerLine;
+    longerLine.moveTo(0, 20);
+    longerLine.lineTo(1e6f, 20);
+    stroke.fDashes = { 10, 10 };
+    stroke.fDashPhase = 0;
+    EXPECT_TRUE(stats, GStrokePath(longerLine, stroke).countPoints() < 100);
+
+    // round caps on a zero-length contour make a dot
+    GPath dot;
+    dot.moveTo(30, 30);
+    dot.lineTo(30, 30);
+    stroke = GStroke();
+    stroke.fWidth = 10;
+    stroke.fCap = GStroke::kRound_Cap;
+    EXPECT_TRUE(stats, stroke_covers(dot, stroke, 30, 30));
+    EXPECT_TRUE(stats, stroke_covers(dot, stroke, 30, 26));
+    EXPECT_FALSE(stats, stroke_covers(dot, stroke, 34, 34));
+
+    // curves are offset on both sides, leaving the middle empty
+    GPath circle;
+    circle.addCircle({30, 30}, 20);
+    stroke = GStroke();
+    stroke.fWidth = 4;
+    stroke.fJoin = GStroke::kRound_Join;
+    EXPECT_TRUE(stats, stroke_covers(circle, stroke, 30, 10));
+    EXPECT_TRUE(stats, stroke_covers(circle, stroke, 49, 30));
+    EXPECT_FALSE(stats, stroke_covers(circle, stroke, 30, 30));
+    EXPECT_FALSE(stats, stroke_covers(circle, stroke, 30, 14));
+}
+
+static bool same_as_rect(const GBitmap& bm, const GRect& rect) {
+    GBitmap expected;
+    expected.alloc(bm.width(), bm.height());
+    GCreateCanvas(expected)->drawRect(rect, GPaint());
+    bool same = same_pixels(bm, expected);
+    free(expected.pixels());
+    return same;
+}
+
+static void test_hairlines(GTestStats* stats) {
+    GBitmap bm;
+    bm.alloc(50, 50);
+    auto canvas = GCreateCanvas(bm);
+    const GPaint paint;
+
+    // covers the columns whose centers lie between the end points
+    for (bool aa : { false, true }) {
+        canvas->clear({0, 0, 0, 0});
+        canvas->drawLine({10.2f, 5.5f}, {20.7f, 5.5f}, paint, aa);
+        EXPECT_TRUE(stats, same_as_rect(bm, GRect::LTRB(10, 5, 21, 6)));
+    }
+
+    canvas->clear({0, 0, 0, 0});
+    canvas->drawLine({5.5f, 40}, {5.5f, 0}, paint);
+    EXPECT_TRUE(stats, same_as_rect(bm, GRect::LTRB(5, 0, 6, 40)));
+
+    // the CTM moves the points, but doesn't widen the line
+    canvas->clear({0, 0, 0, 0});
+    canvas->save();
+    canvas->scale(3, 3);
+    canvas->drawLine({1, 1.5f}, {5, 1.5f}, paint);
+    canvas->restore();
+    EXPECT_TRUE(stats, same_as_rect(bm, GRect::LTRB(3, 4, 15, 5)));
+
+    // clipped to the device, one pixel per column
+    canvas->clear({0, 0, 0, 0});
+    canvas->drawLine({-100, -100}, {200, 200}, paint);
+    int hits = 0;
+    for (int y = 0; y < 50; ++y) {
+        for (int x = 0; x < 50; ++x) {
+            if (*bm.getAddr(x, y)) {
+                hits += 1;
+                EXPECT_EQ(stats, x, y);
+            }
+        }
+    }
+    EXPECT_EQ(stats, hits, 50);
+
+    // connected lines don't blend their shared point twice
+    canvas->clear({0, 0, 0, 0});
+    const GPoint pts[] = { {2, 2.5f}, {10, 2.5f}, {10, 2.5f}, {20, 2.5f} };
+    canvas->drawHairlines(pts, 2, GPaint({0, 0, 0, 0.5f}), false);
+    EXPECT_EQ(stats, *bm.getAddr(10, 2), *bm.getAddr(5, 2));
+
+    // antialiasing splits the coverage between the two nearest rows
+    canvas->clear({0, 0, 0, 0});
+    canvas->drawLine({0, 6}, {20, 6}, paint, true);
+    int a5 = GPixel_GetA(*bm.getAddr(10, 5));
+    int a6 = GPixel_GetA(*bm.getAddr(10, 6));
+    EXPECT_EQ(stats, a5 + a6, 255);
+    EXPECT_TRUE(stats, abs(a5 - a6) <= 1);
+    EXPECT_EQ(stats, *bm.getAddr(10, 4), 0u);
+    EXPECT_EQ(stats, *bm.getAddr(10, 7), 0u);
+
+    free(bm.pixels());
+}
+
+static void test_clip(GTestStats* stats) {
+    GBitmap a, b;
+    a.alloc(50, 50);
+    b.alloc(50, 50);
+    auto ca = GCreateCanvas(a);
+    auto cb = GCreateCanvas(b);
+    const GPaint paint;
+    const GRect all = GRect::LTRB(-10, -10, 60, 60);
+
+    GPath allPath;
+    allPath.addRect(all);
+    const GPoint allPoly[] = { {-10, -10}, {60, -10}, {60, 60}, {-10, 60} };
+
+    // a rect clip (mapped by the CTM) limits every kind of draw
+    ca->save();
+    ca->scale(2, 2);
+    ca->clipRect(GRect::LTRB(5, 5, 15, 15));
+    ca->drawRect(all, paint);
+    EXPECT_TRUE(stats, same_as_rect(a, GRect::LTRB(10, 10, 30, 30)));
+    ca->clear({0, 0, 0, 0});
+    ca->drawPath(allPath, paint);
+    EXPECT_TRUE(stats, same_as_rect(a, GRect::LTRB(10, 10, 30, 30)));
+    ca->clear({0, 0, 0, 0});
+    ca->drawConvexPolygon(allPoly, 4, paint);
+    EXPECT_TRUE(stats, same_as_rect(a, GRect::LTRB(10, 10, 30, 30)));
+    ca->clear({0, 0, 0, 0});
+    ca->drawLine({-10, 10.25f}, {60, 10.25f}, paint);
+    EXPECT_TRUE(stats, same_as_rect(a, GRect::LTRB(10, 20, 30, 21)));
+    ca->restore();
+
+    // restore brings back the unclipped device
+    ca->drawRect(all, paint);
+    EXPECT_TRUE(stats, same_as_rect(a, GRect::LTRB(0, 0, 50, 50)));
+
+    // a path clip covers what drawing the path would
+    GPath circle;
+    circle.addCircle({25, 25}, 18);
+    ca->clear({0, 0, 0, 0});
+    ca->save();
+    ca->clipPath(circle);
+    ca->drawRect(all, paint);
+    ca->restore();
+    cb->clear({0, 0, 0, 0});
+    cb->drawPath(circle, paint);
+    EXPECT_TRUE(stats, same_pixels(a, b));
+
+    // so does a rect clip that the CTM rotates
+    GPath rect;
+    rect.addRect(GRect::LTRB(5, 5, 20, 30));
+    for (GCanvas* c : { ca.get(), cb.get() }) {
+        c->clear({0, 0, 0, 0});
+        c->save();
+        c->translate(25, 5);
+        c->rotate(0.5f);
+    }
+    ca->clipRect(GRect::LTRB(5, 5, 20, 30));
+    ca->drawPath(allPath, paint);
+    cb->drawPath(rect, paint);
+    ca->restore();
+    cb->restore();
+    EXPECT_TRUE(stats, same_pixels(a, b));
+
+    // clips intersect
+    GPath left, right;
+    left.addCircle({20, 25}, 15);
+    right.addCircle({30, 25}, 15);
+    ca->clear({0, 0, 0, 0});
+    ca->save();
+    ca->clipPath(left);
+    ca->clipPath(right);
+    ca->drawLine({0, 25.5f}, {50, 25.5f}, paint);
+    ca->drawRect(GRect::LTRB(0, 0, 50, 10), paint);
+    ca->restore();
+    EXPECT_TRUE(stats, *a.getAddr(25, 25) != 0);
+    EXPECT_TRUE(stats, *a.getAddr(12, 25) == 0);
+    EXPECT_TRUE(stats, *a.getAddr(38, 25) == 0);
+    EXPECT_TRUE(stats, *a.getAddr(25, 5) == 0);
+
+    // an empty clip draws nothing
+    ca->clear({0, 0, 0, 0});
+    ca->save();
+    ca->clipRect(GRect::LTRB(0, 0, 10, 10));
+    ca->clipRect(GRect::LTRB(20, 20, 30, 30));
+    ca->drawRect(all, paint);
+    ca->drawPath(allPath, paint);
+    ca->restore();
+    EXPECT_TRUE(stats, same_as_rect(a, GRect::LTRB(0, 0, 0, 0)));
+
+    free(a.pixels());
+    free(b.pixels());
+}
+
+static void test_quick_reject(GTestStats* stats) {
+    GBitmap bm;
+    bm.alloc(50, 50);
+    auto canvas = GCreateCanvas(bm);
+
+    EXPECT_FALSE(stats, canvas->quickReject(GRect::LTRB(40, 40, 60, 60)));
+    EXPECT_TRUE(stats, canvas->quickReject(GRect::LTRB(50, 0, 60, 10)));
+    EXPECT_TRUE(stats, canvas->quickReject(GRect::LTRB(-20, -20, -1, 60)));
+
+    canvas->save();
+    canvas->translate(-100, 0);
+    EXPECT_TRUE(stats, canvas->quickReject(GRect::LTRB(40, 40, 60, 60)));
+    EXPECT_FALSE(stats, canvas->quickReject(GRect::LTRB(90, 0, 110, 10)));
+    canvas->restore();
+
+    canvas->save();
+    canvas->clipRect(GRect::LTRB(10, 10, 20, 20));
+    EXPECT_TRUE(stats, canvas->quickReject(GRect::LTRB(30, 30, 40, 40)));
+    EXPECT_FALSE(stats, canvas->quickReject(GRect::LTRB(15, 15, 40, 40)));
+    canvas->restore();
+
+    // every kind of draw counts, and is rejected when it lies off the device
+    const GPaint paint;
+    GPath path;
+    path.addCircle({-30, 20}, 10);
+    const GPoint pts[] = { {-20, 0}, {-10, 0}, {-10, 10}, {-20, 10} };
+    const GPoint line[] = { {-20, 5}, {-2, 5} };
+    const int indices[] = { 0, 1, 2,  2, 3, 0 };
+    const GColor colors[] = {{1,0,0,1}, {0,1,0,1}, {0,0,1,1}, {1,1,1,1}};
+
+    canvas->resetStats();
+    canvas->drawRect(GRect::LTRB(-20, 0, -10, 10), paint);
+    canvas->drawConvexPolygon(pts, 4, paint);
+    canvas->drawPath(path, paint);
+    canvas->drawHairlines(line, 1, paint, false);
+    canvas->drawMesh(pts, colors, nullptr, 2, indices, paint);
+    canvas->drawQuad(pts, colors, nullptr, 1, paint);
+    EXPECT_EQ(stats, canvas->stats().fDraws, 6);
+    EXPECT_EQ(stats, canvas->stats().fRejectedDraws, 6);
+
+    // visible draws aren't rejected, and a quad counts once (not once per triangle)
+    canvas->resetStats();
+    canvas->translate(30, 0);
+    canvas->drawRect(GRect::LTRB(-20, 0, -10, 10), paint);
+    canvas->drawQuad(pts, colors, nullptr, 1, paint);
+    EXPECT_EQ(stats, canvas->stats().fDraws, 2);
+    EXPECT_EQ(stats, canvas->stats().fRejectedDraws, 0);
+
+    free(bm.pixels());
+}
+
+static void test_save_layer(GTestStats* stats) {
+    GBitmap a, b;
+    a.alloc(50, 50);
+    b.alloc(50, 50);
+    auto ca = GCreateCanvas(a);
+    auto cb = GCreateCanvas(b);
+    const GPaint red({1, 0, 0, 1});
+
+    // group opacity: the overlap isn't blended twice
+    GPaint half;
+    half.setAlpha(0.5f);
+    ca->saveLayer(nullptr, &half);
+    ca->drawRect(GRect::LTRB(5, 5, 30, 30), red);
+    ca->drawRect(GRect::LTRB(20, 20, 45, 45), red);
+    ca->restore();
+    GPath both;
+    both.addRect(GRect::LTRB(5, 5, 30, 30));
+    both.addRect(GRect::LTRB(20, 20, 45, 45));
+    cb->drawPath(both, GPaint({1, 0, 0, 0.5f}));
+    EXPECT_TRUE(stats, same_pixels(a, b));
+
+    // the layer is limited to its bounds (mapped by the CTM), and drawn with its blend mode
+    for (GCanvas* c : { ca.get(), cb.get() }) {
+        c->clear({0, 0, 1, 1});
+    }
+    ca->save();
+    ca->translate(10, 10);
+    GPaint src;
+    src.setBlendMode(GBlendMode::kSrc);
+    const GRect bounds = GRect::LTRB(0, 0, 20, 20);
+    ca->saveLayer(&bounds, &src);
+    ca->drawRect(GRect::LTRB(-10, -10, 10, 10), red);
+    ca->restore();
+    ca->restore();
+    cb->drawRect(GRect::LTRB(10, 10, 30, 30), GPaint({0, 0, 0, 0}).setBlendMode(GBlendMode::kSrc));
+    cb->drawRect(GRect::LTRB(10, 10, 20, 20), red);
+    EXPECT_TRUE(stats, same_pixels(a, b));
+
+    // nested layers, with clear() only filling the innermost one
+    for (GCanvas* c : { ca.get(), cb.get() }) {
+        c->clear({0, 0, 0, 0});
+    }
+    GPaint quarter;
+    quarter.setAlpha(0.25f);
+    const GRect inner = GRect::LTRB(10, 10, 20, 20);
+    ca->saveLayer(nullptr, nullptr);
+    ca->drawRect(GRect::LTRB(0, 0, 10, 50), red);
+    ca->saveLayer(&inner, &quarter);
+    ca->clear({0, 1, 0, 1});
+    ca->restore();
+    ca->restore();
+    cb->drawRect(GRect::LTRB(0, 0, 10, 50), red);
+    cb->drawRect(inner, GPaint({0, 1, 0, 0.25f}));
+    EXPECT_TRUE(stats, same_pixels(a, b));
+
+    free(a.pixels());
+    free(b.pixels());
+}
+
+static bool same_irect(const GIRect& a, const GIRect& b) {
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+static void test_dirty_bounds(GTestStats* stats) {
+    GBitmap bm;
+    bm.alloc(50, 50);
+    auto canvas = GCreateCanvas(bm);
+    const GPaint paint;
+    EXPECT_TRUE(stats, canvas->dirtyBounds().isEmpty());
+
+    // draws add their (rounded out) device bounds; paths add the spans they actually filled
+    canvas->drawRect(GRect::LTRB(10.2f, 10.7f, 20, 20), paint);
+    EXPECT_TRUE(stats, same_irect(canvas->dirtyBounds(), GIRect::LTRB(10, 10, 20, 20)));
+    GPath dot;
+    dot.addRect(GRect::LTRB(30, 32, 40, 44));
+    canvas->drawPath(dot, paint);
+    EXPECT_TRUE(stats, same_irect(canvas->dirtyBounds(), GIRect::LTRB(10, 10, 40, 44)));
+
+    // rejected draws, and the clip, keep it small
+    canvas->resetDirty();
+    EXPECT_TRUE(stats, canvas->dirtyBounds().isEmpty());
+    canvas->drawRect(GRect::LTRB(60, 0, 70, 10), paint);
+    GPath offDevice = dot;
+    offDevice.offset(-100, 0);
+    canvas->drawPath(offDevice, paint);
+    EXPECT_TRUE(stats, canvas->dirtyBounds().isEmpty());
+    canvas->save();
+    canvas->clipRect(GRect::LTRB(0, 0, 15, 5));
+    canvas->drawRect(GRect::LTRB(-10, -10, 100, 100), paint);
+    canvas->restore();
+    EXPECT_TRUE(stats, same_irect(canvas->dirtyBounds(), GIRect::LTRB(0, 0, 15, 5)));
+
+    // a layer dirties what it covers when it is composited, not before
+    canvas->resetDirty();
+    const GRect bounds = GRect::LTRB(20, 20, 30, 30);
+    canvas->saveLayer(&bounds, nullptr);
+    canvas->drawRect(GRect::LTRB(22, 22, 24, 24), paint);
+    EXPECT_TRUE(stats, canvas->dirtyBounds().isEmpty());
+    canvas->restore();
+    EXPECT_TRUE(stats, same_irect(canvas->dirtyBounds(), GIRect::LTRB(20, 20, 30, 30)));
+
+    canvas->clear({0, 0, 0, 0});
+    EXPECT_TRUE(stats, same_irect(canvas->dirtyBounds(), GIRect::WH(50, 50)));
+
+    free(bm.pixels());
+}
+
+static void test_png_writer(GTestStats* stats) {
+    // the reciprocal table unpremultiplies exactly as dividing would
+    bool exact = true;
+    for (int a = 0; a < 256; ++a) {
+        for (int c = 0; c <= a; ++c) {
+            GPixel p = GPixel_PackARGB(a, c, c, c);
+            uint8_t rgba[4];
+            GPNGUnpremulRow(&p, 1, rgba);
+            int expected = (a == 0 || a == 255) ? c : (c * 255 + a/2) / a;
+            exact &= rgba[0] == expected && rgba[1] == expected && rgba[2] == expected;
+        }
+    }
+    EXPECT_TRUE(stats, exact);
+
+    // big enough for several stored blocks, IDAT chunks and window slides, with translucency
+    GBitmap src;
+    src.alloc(300, 240);
+    auto canvas = GCreateCanvas(src);
+    const GColor colors[] = {{1, 0, 0, 1}, {0, 1, 0, 0.5f}, {0, 0, 1, 0}};
+    auto shader = GCreateLinearGradient({0, 0}, {300, 240}, colors, 3);
+    canvas->drawRect(GRect::WH(300, 240), GPaint(shader.get()));
+    GPath dots;
+    for (int i = 0; i < 20; ++i) {
+        dots.addCircle({15.0f * i, 120}, 4.0f + i);
+    }
+    canvas->drawPath(dots, GPaint({0.2f, 0.4f, 0.6f, 0.3f}));
+
+    const char* path = "png_writer_test.png";
+    GBitmap reference;
+    EXPECT_TRUE(stats, src.writeToFile(path) && reference.readFromFile(path));
+
+    for (int c = GPNGOptions::kStore; c <= GPNGOptions::kBest; ++c) {
+        for (int f = GPNGOptions::kNone_Filter; f <= GPNGOptions::kAdaptive_Filter; ++f) {
+            GPNGOptions options;
+            options.fCompression = (GPNGOptions::Compression)c;
+            options.fFilter = (GPNGOptions::Filter)f;
+            GBitmap decoded;
+            bool ok = src.writeToFile(path, options) && decoded.readFromFile(path);
+            EXPECT_TRUE(stats, ok && same_pixels(decoded, reference));
+            free(decoded.pixels());
+
+            // banded across threads: seams primed from the band before, adlers combined
+            if (c <= GPNGOptions::kFast) {
+                options.fThreads = 3;
+                ok = src.writeToFile(path, options) && decoded.readFromFile(path);
+                EXPECT_TRUE(stats, ok && same_pixels(decoded, reference));
+                free(decoded.pixels());
+            }
+        }
+    }
+    remove(path);
+
+    free(reference.pixels());
+    free(src.pixels());
+}
+
+// The plain decode: lodepng's RGBA, premultiplied with divides.
+static bool same_as_rgba_decode(const char path[], const GBitmap& bm) {
+    unsigned w, h;
+    unsigned char* rgba = nullptr;
+    if (lodepng_decode32_file(&rgba, &w, &h, path)) {
+        free(rgba);
+        return false;
+    }
+    bool same = (int)w == bm.width() && (int)h == bm.height();
+    bool opaque = true;
+    for (unsigned y = 0; same && y < h; ++y) {
+        for (unsigned x = 0; x < w; ++x) {
+            const uint8_t* p = rgba + (y * w + x) * 4;
+            unsigned a = p[3];
+            GPixel expected = GPixel_PackARGB(a, (a * p[0] + 127) / 255, (a * p[1] + 127) / 255,
+                                              (a * p[2] + 127) / 255);
+            same &= *bm.getAddr(x, y) == expected;
+            opaque &= a == 0xFF;
+        }
+    }
+    free(rgba);
+    return same && opaque == bm.isOpaque();
+}
+
+static void test_png_reader(GTestStats* stats) {
+    // RGB (decoded as is), RGB with a transparent color key, RGBA with translucency, palette
+    for (const char* path : { "apps/spock.png", "expected/path_graphs.png", "apps/wheel.png",
+                              "expected/blend_black.png" }) {
+        GBitmap bm;
+        EXPECT_TRUE(stats, bm.readFromFile(path) && same_as_rgba_decode(path, bm));
+        free(bm.pixels());
+    }
+
+    GBitmap missing;
+    EXPECT_FALSE(stats, missing.readFromFile("no/such/file.png"));
+    EXPECT_TRUE(stats, missing.pixels() == nullptr);
+}
+
+static void test_mapped_bitmap(GTestStats* stats) {
+    // translucent, opaque, and a tight source stride that the file repacks to the preferred one
+    for (const char* png : { "apps/wheel.png", "apps/spock.png" }) {
+        GBitmap src;
+        EXPECT_TRUE(stats, src.readFromFile(png));
+        const char* path = "mapped_bitmap_test.graw";
+        EXPECT_TRUE(stats, GMappedBitmap::Write(src, path));
+
+        GMappedBitmap mapped = GMappedBitmap::Map(path);
+        EXPECT_TRUE(stats, same_pixels(*mapped, src));
+        EXPECT_TRUE(stats, mapped->isOpaque() == src.isOpaque());
+        EXPECT_TRUE(stats, mapped->rowBytes() == GBitmap::PreferredRowBytes(src.width()));
+        EXPECT_TRUE(stats, ((uintptr_t)mapped->pixels() & 63) == 0);
+
+        // the mapping survives the file going away, and moves with ownership
+        remove(path);
+        GMappedBitmap moved = std::move(mapped);
+        EXPECT_TRUE(stats, mapped->pixels() == nullptr && same_pixels(*moved, src));
+        free(src.pixels());
+    }
+
+    // missing, not a raw image, truncated
+    EXPECT_TRUE(stats, GMappedBitmap::Map("no/such/file.graw")->pixels() == nullptr);
+    EXPECT_TRUE(stats, GMappedBitmap::Map("apps/spock.png")->pixels() == nullptr);
+    GBitmap small;
+    small.alloc(16, 16);
+    memset(small.pixels(), 0, 16 * small.rowBytes());
+    const char* path = "mapped_bitmap_test.graw";
+    EXPECT_TRUE(stats, GMappedBitmap::Write(small, path));
+    EXPECT_TRUE(stats, truncate(path, 64 + 15 * small.rowBytes()) == 0);
+    EXPECT_TRUE(stats, GMappedBitmap::Map(path)->pixels() == nullptr);
+    remove(path);
+
+    // corrupt sizes in the header (width, height, rowBytes at offset 8): empty rows, whose
+    // pixels always "fit", and heights that don't fit in an int
+    const uint32_t corrupt[][3] = {
+        { 0, 16, 0 }, { 0, 0x80000000u, 0 }, { 16, 0x80000000u, 0 }, { 16, 0, 64 },
+    };
+    for (const auto& sizes : corrupt) {
+        EXPECT_TRUE(stats, GMappedBitmap::Write(small, path));
+        FILE* f = fopen(path, "r+b");
+        EXPECT_TRUE(stats, f && fseek(f, 8, SEEK_SET) == 0 && fwrite(sizes, 4, 3, f) == 3);
+        if (f) {
+            fclose(f);
+        }
+        EXPECT_TRUE(stats, GMappedBitmap::Map(path)->pixels() == nullptr);
+        remove(path);
+    }
+    free(small.pixels());
+}
+
+static void test_opaque_dst(GTestStats* stats) {
+    // the vector and scalar parts of ComputeIsOpaque both find a single translucent pixel
+    GBitmap bm;
+    bm.alloc(37, 3);
+    for (int x = 0; x < 37; ++x) {
+        for (int y = 0; y < 3; ++y) {
+            *bm.getAddr(x, y) = GPixel_PackARGB(0xFF, x, y, 0);
+        }
+    }
+    bm.setIsOpaque(GBitmap::kCompute_IsOpaque);
+    EXPECT_TRUE(stats, bm.isOpaque());
+    for (int x : { 0, 5, 31, 32, 36 }) {
+        *bm.getAddr(x, 2) = GPixel_PackARGB(0xFE, x, 2, 0);
+        bm.setIsOpaque(GBitmap::kCompute_IsOpaque);
+        EXPECT_FALSE(stats, bm.isOpaque());
+        *bm.getAddr(x, 2) = GPixel_PackARGB(0xFF, x, 2, 0);
+    }
+    free(bm.pixels());
+
+    // Drawing into a dst known to be opaque takes the shortcuts, one that isn't takes the general
+    // procs: every mode, in turn, must leave the same pixels either way. Some of them make the
+    // dst translucent, after which the known-opaque canvas must stop taking shortcuts.
+    GBitmap known, unknown;
+    EXPECT_TRUE(stats, known.readFromFile("apps/spock.png") && known.isOpaque());
+    unknown.alloc(known.width(), known.height());
+    auto knownCanvas = GCreateCanvas(known);
+    auto unknownCanvas = GCreateCanvas(unknown);
+    for (int y = 0; y < known.height(); ++y) {
+        memcpy(unknown.getAddr(0, y), known.getAddr(0, y), known.width() * sizeof(GPixel));
+    }
+
+    // first running on from spock, so the modes that make the dst translucent leave it that way
+    // for the ones after; then from an opaque clear each time
+    const GColor colors[] = {{0.8f, 0.2f, 0.4f, 0.6f}, {0.1f, 0.9f, 0.3f, 1}, {1, 1, 1, 0}};
+    for (bool clearFirst : { false, true }) {
+        for (int mode = 0; mode <= (int)GBlendMode::kXor; ++mode) {
+            if (clearFirst) {
+                knownCanvas->clear({0.5f, 0.25f, 0.75f, 1});
+                unknownCanvas->clear({0.5f, 0.25f, 0.75f, 1});
+            }
+            for (int c = 0; c < 3; ++c) {
+                GPaint paint(colors[c]);
+                paint.setBlendMode((GBlendMode)mode);
+                GRect rect = GRect::XYWH(7.0f * mode + c, 5.0f * c, 40, 30);
+                knownCanvas->drawRect(rect, paint);
+                unknownCanvas->drawRect(rect, paint);
+                EXPECT_TRUE(stats, same_pixels(known, unknown));
+            }
+        }
+    }
+
+    free(known.pixels());
+    free(unknown.pixels());
+}
+
+static int count_nonzero(const GBitmap& bm) {
+    int count = 0;
+    for (int y = 0; y < bm.height(); ++y) {
+        for (int x = 0; x < bm.width(); ++x) {
+            count += *bm.getAddr(x, y) != 0;
+        }
+    }
+    return count;
+}
+
+static void test_draw_rects(GTestStats* stats) {
+    // a batch draws what the rects drawn one by one would, under every kind of CTM: identity,
+    // scale and translate (some flipped, some batches bigger than the mapping step), and a
+    // rotation that takes the polygon path
+    GRandom rand;
+    const int N = 150;
+    GRect rects[N];
+    GPaint paints[N];
+    for (int i = 0; i < N; ++i) {
+        float x = rand.nextF() * 140 - 20, y = rand.nextF() * 140 - 20;
+        rects[i] = GRect::XYWH(x, y, rand.nextF() * 40, rand.nextF() * 40);
+        paints[i] = GPaint({rand.nextF(), rand.nextF(), rand.nextF(), rand.nextF()});
+        paints[i].setBlendMode((GBlendMode)(i % ((int)GBlendMode::kXor + 1)));
+    }
+
+    const GMatrix matrices[] = {
+        GMatrix(),
+        GMatrix(1.5f, 0, 3.25f, 0, 0.75f, -2),
+        GMatrix(-1, 0, 100, 0, 1, 0),
+        GMatrix::Rotate(0.3f),
+    };
+    for (const GMatrix& m : matrices) {
+        for (bool shared : { false, true }) {
+            GBitmap one, batch;
+            one.alloc(100, 100);
+            batch.alloc(100, 100);
+            auto oneCanvas = GCreateCanvas(one);
+            auto batchCanvas = GCreateCanvas(batch);
+            oneCanvas->clipRect(GRect::LTRB(5, 5, 95, 90));
+            batchCanvas->clipRect(GRect::LTRB(5, 5, 95, 90));
+            oneCanvas->concat(m);
+            batchCanvas->concat(m);
+
+            // paints[3] is kSrcOver, so the shared paint leaves something to see
+            for (int i = 0; i < N; ++i) {
+                oneCanvas->drawRect(rects[i], shared ? paints[3] : paints[i]);
+            }
+            if (shared) {
+                batchCanvas->drawRects(rects, N, paints[3]);
+            } else {
+                batchCanvas->drawRects(rects, paints, N);
+            }
+
+            EXPECT_TRUE(stats, same_pixels(one, batch));
+            // and each of them drew something, mirrored or not
+            EXPECT_TRUE(stats, count_nonzero(one) > 0 && count_nonzero(batch) > 0);
+            GCanvasStats a = oneCanvas->stats(), b = batchCanvas->stats();
+            EXPECT_TRUE(stats, a.fDraws == N && b.fDraws == N);
+            EXPECT_TRUE(stats, a.fRejectedDraws == b.fRejectedDraws);
+            EXPECT_TRUE(stats, same_irect(oneCanvas->dirtyBounds(), batchCanvas->dirtyBounds()));
+            free(one.pixels());
+            free(batch.pixels());
+        }
+    }
+}
+
+static void test_map_points(GTestStats* stats) {
+    GMatrix identity, translate = GMatrix::Translate(3.5f, -2),
+            scale = GMatrix(2, 0, 1, 0, -0.5f, 4), rotate = GMatrix::Rotate(0.7f);
+    EXPECT_TRUE(stats, identity.getType() == GMatrix::kIdentity_Mask);
+    EXPECT_TRUE(stats, translate.getType() ==
+                       (GMatrix::kTranslate_Mask | GMatrix::kFractional_Mask));
+    EXPECT_TRUE(stats, translate.isTranslate() && !translate.isIntegerTranslate());
+    EXPECT_TRUE(stats, GMatrix::Translate(-3, 7).isIntegerTranslate());
+    EXPECT_TRUE(stats, GMatrix::Concat(translate, GMatrix::Translate(0.5f, 0)).isIntegerTranslate());
+    EXPECT_TRUE(stats, (*translate.invert()).isTranslate());
+    EXPECT_TRUE(stats, scale.getType() == (GMatrix::kScale_Mask | GMatrix::kTranslate_Mask));
+    EXPECT_TRUE(stats, rotate.getType() == (GMatrix::kScale_Mask | GMatrix::kAffine_Mask));
+    EXPECT_TRUE(stats, GMatrix::Scale(2, 2).isScaleTranslate() && !rotate.isScaleTranslate());
+
+    // changing an entry reclassifies
+    GMatrix m;
+    EXPECT_TRUE(stats, m.isIdentity());
+    m.set(2, 0.25f);
+    EXPECT_TRUE(stats, m.getType() == GMatrix::kAffine_Mask);
+    m[2] = 0;
+    EXPECT_TRUE(stats, m.isIdentity() && m[2] == 0);
+    m[4] += 2;
+    EXPECT_TRUE(stats, m.isIntegerTranslate() && !m.isIdentity());
+    m[4] = 0;
+    m[2] = 0.25f;
+    EXPECT_TRUE(stats, m.getType() == GMatrix::kAffine_Mask);
+
+    // every kind maps as the plain formula does, whatever the count (vector and scalar parts),
+    // in place or not
+    GRandom rand;
+    GPoint src[37], dst[37];
+    for (GPoint& p : src) {
+        p = { rand.nextF() * 200 - 100, rand.nextF() * 200 - 100 };
+    }
+    for (const GMatrix& mx : { identity, translate, scale, rotate, m }) {
+        for (int count : { 0, 1, 2, 5, 37 }) {
+            mx.mapPoints(dst, src, count);
+            GPoint inPlace[37];
+            memcpy(inPlace, src, sizeof(src));
+            mx.mapPoints(inPlace, count);
+
+            bool same = true;
+            for (int i = 0; i < count; ++i) {
+                GPoint expected = { mx[0] * src[i].x + mx[2] * src[i].y + mx[4],
+                                    mx[1] * src[i].x + mx[3] * src[i].y + mx[5] };
+                same &= dst[i] == expected && inPlace[i] == expected;
+            }
+            EXPECT_TRUE(stats, same);
+        }
+    }
+}
+
+static void test_bitmap_integer_translate(GTestStats* stats) {
+    // a clamped bitmap drawn at whole-pixel offsets (the shader's and the CTM's) is copied row
+    // by row, with its edge pixels repeated past its sides
+    GBitmap src;
+    bool loaded = src.readFromFile("apps/wheel.png");
+    EXPECT_TRUE(stats, loaded);
+    if (!loaded) {
+        return;     // run from outside the repo
+    }
+    auto shader = GCreateBitmapShader(src, GMatrix::Translate(-30, 25), GTileMode::kClamp);
+
+    GBitmap dst;
+    dst.alloc(src.width() + 40, src.height() + 40);
+    auto canvas = GCreateCanvas(dst);
+    canvas->translate(12, -8);
+    GPaint paint(shader.get());
+    paint.setBlendMode(GBlendMode::kSrc);
+    canvas->drawRect(GRect::LTRB(-12, 8, dst.width() - 12.0f, dst.height() + 8.0f), paint);
+
+    bool same = true;
+    for (int y = 0; y < dst.height(); ++y) {
+        for (int x = 0; x < dst.width(); ++x) {
+            int sx = std::max(0, std::min(x - 12 + 30, src.width() - 1));
+            int sy = std::max(0, std::min(y + 8 - 25, src.height() - 1));
+            same &= *dst.getAddr(x, y) == *src.getAddr(sx, sy);
+        }
+    }
+    EXPECT_TRUE(stats, same);
+
+    free(dst.pixels());
+    free(src.pixels());
+}
+
+static void test_deferred_save(GTestStats* stats) {
+    // Random nests of save/translate/clip/restore, checked against a plain stack of offsets and
+    // clips: a save with no change before its restore is only counted, so the state a restore
+    // returns to must still be the right one however the saves and changes interleave.
+    GBitmap bm;
+    bm.alloc(64, 64);
+    auto canvas = GCreateCanvas(bm);
+    struct Model { int dx, dy; GIRect clip; };
+    std::vector<Model> model = {{ 0, 0, GIRect::WH(64, 64) }};
+
+    GRandom rand;
+    bool ok = true;
+    for (int step = 0; step < 400; ++step) {
+        int op = rand.nextRange(0, 4);
+        if (op == 0 || (op == 1 && model.size() == 1)) {
+            canvas->save();
+            model.push_back(model.back());
+        } else if (op == 1) {
+            canvas->restore();
+            model.pop_back();
+        } else if (op == 2) {
+            int dx = rand.nextRange(-3, 3), dy = rand.nextRange(-3, 3);
+            canvas->translate((float)dx, (float)dy);
+            model.back().dx += dx;
+            model.back().dy += dy;
+        } else if (op == 3 && rand.nextRange(0, 3) == 0) {
+            // in local space, so it lands at the current offset
+            GIRect& clip = model.back().clip;
+            int l = rand.nextRange(0, 20), t = rand.nextRange(0, 20);
+            canvas->clipRect(GRect::XYWH((float)l, (float)t, 40, 40));
+            GIRect r = GIRect::XYWH(l + model.back().dx, t + model.back().dy, 40, 40);
+            clip = GIRect::LTRB(std::max(clip.left, r.left), std::max(clip.top, r.top),
+                                std::min(clip.right, r.right), std::min(clip.bottom, r.bottom));
+            if (clip.isEmpty()) {
+                clip = GIRect::LTRB(0, 0, 0, 0);
+            }
+        } else {
+            // the device bounds of a local rect show both the offset and the clip
+            canvas->resetDirty();
+            canvas->drawRect(GRect::XYWH(20, 20, 10, 10), GPaint({1, 0, 0, 1}));
+            const Model& m = model.back();
+            GIRect r = GIRect::XYWH(20 + m.dx, 20 + m.dy, 10, 10);
+            GIRect expected = GIRect::LTRB(std::max(m.clip.left, r.left),
+                                           std::max(m.clip.top, r.top),
+                                           std::min(m.clip.right, r.right),
+                                           std::min(m.clip.bottom, r.bottom));
+            GIRect dirty = canvas->dirtyBounds();
+            ok &= expected.isEmpty() ? dirty.isEmpty() : same_irect(dirty, expected);
+        }
+    }
+    EXPECT_TRUE(stats, ok);
+
+    // a layer over saves that were never copied still composites on its restore
+    canvas = GCreateCanvas(bm);
+    canvas->clear({0, 0, 0, 0});
+    canvas->save();
+    canvas->save();
+    GPaint half;
+    half.setAlpha(0.5f);
+    canvas->saveLayer(nullptr, &half);
+    canvas->drawRect(GRect::WH(4, 4), GPaint({0, 0, 1, 1}));
+    canvas->restore();
+    EXPECT_TRUE(stats, GPixel_GetA(*bm.getAddr(1, 1)) == 128);
+    canvas->restore();
+    canvas->restore();
+    free(bm.pixels());
+}
+
+static std::string read_all(FILE* f) {
+    std::string str;
+    rewind(f);
+    char buffer[256];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        str.append(buffer, n);
+    }
+    return str;
+}
+
+static void test_instrument(GTestStats* stats) {
+    // Counted only in a -DG_INSTRUMENT build (make itests); otherwise the hooks are gone and the
+    // counters stay zero however much is drawn.
+    GBitmap bm;
+    bm.alloc(32, 32);
+    auto canvas = GCreateCanvas(bm);
+
+    GInstrument::BeginFrame();
+    canvas->clear({0, 0, 0, 0});
+    canvas->drawRect(GRect::XYWH(2, 2, 10, 10), GPaint({1, 0, 0, 1}));
+    GRect rects[2] = { GRect::XYWH(0, 20, 4, 2), GRect::XYWH(8, 20, 4, 2) };
+    GPaint xor_paint({0, 1, 0, 1});
+    xor_paint.setBlendMode(GBlendMode::kXor);
+    canvas->drawRects(rects, 2, xor_paint);
+    GPath path;
+    path.moveTo({16, 16});
+    path.quadTo({31, 16}, {31, 31});
+    path.lineTo({16, 31});
+    canvas->drawPath(path, GPaint({0, 0, 1, 1}));
+
+    const GFrameCounters& c = GInstrument::Counters();
+    const auto& rect = c.fPrimitives[(int)GPrimitive::kRect];
+    const auto& fill = c.fPrimitives[(int)GPrimitive::kPath];
+    if (GInstrument::kEnabled) {
+        EXPECT_TRUE(stats, c.fPrimitives[(int)GPrimitive::kClear].fCalls == 1);
+        EXPECT_TRUE(stats, rect.fCalls == 2 && rect.fSpans == 14 && rect.fPixels == 116);
+        EXPECT_TRUE(stats, c.fBlendedPixels[(int)GBlendMode::kXor] == 16);
+        EXPECT_TRUE(stats, fill.fCalls == 1 && fill.fSpans > 0 && fill.fPixels > 0);
+        EXPECT_TRUE(stats, c.fBlendedPixels[(int)GBlendMode::kSrcOver] == 100 + fill.fPixels);
+        EXPECT_TRUE(stats, c.fEdges >= 3 && c.fCurves == 1);
+    } else {
+        EXPECT_TRUE(stats, rect.fCalls == 0 && fill.fPixels == 0 && c.fEdges == 0);
+    }
+
+    FILE* f = tmpfile();
+    EXPECT_TRUE(stats, f && GInstrument::WriteJSON(f));
+    std::string json = f ? read_all(f) : "";
+    std::string expected = GInstrument::kEnabled ? "\"rect\": { \"calls\": 2" : "\"edges\": 0";
+    EXPECT_TRUE(stats, json.find(expected) != std::string::npos);
+    if (f) {
+        fclose(f);
+    }
+
+    f = tmpfile();
+    EXPECT_TRUE(stats, f && GInstrument::WriteTrace(f));
+    std::string trace = f ? read_all(f) : "";
+    EXPECT_TRUE(stats, trace.find("{\"traceEvents\":[") == 0);
+    EXPECT_TRUE(stats, (trace.find("\"name\":\"path\"") != std::string::npos) ==
+                       GInstrument::kEnabled);
+    if (f) {
+        fclose(f);
+    }
+    free(bm.pixels());
+}
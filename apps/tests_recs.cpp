@@ -14,6 +14,7 @@
 #include "tests_pa3.cpp"
 #include "tests_pa4.cpp"
 #include "tests_pa5.cpp"
+#include "tests_perf.cpp"
 
 const GTestRec gTestRecs[] = {
     { test_clear,       "clear"         },
@@ -39,6 +40,25 @@ const GTestRec gTestRecs[] = {
     { test_path_chop_cubic,   "path_chop_cubic"    },
     { test_path_bounds, "path_bounds" },
 
+    { test_path_flat_cache, "path_flat_cache" },
+    { test_path_cull,       "path_cull"       },
+    { test_convex_poly,     "convex_poly"     },
+    { test_stroke,          "stroke"          },
+    { test_hairlines,       "hairlines"       },
+    { test_clip,            "clip"            },
+    { test_quick_reject,    "quick_reject"    },
+    { test_save_layer,      "save_layer"      },
+    { test_dirty_bounds,    "dirty_bounds"    },
+    { test_png_writer,      "png_writer"      },
+    { test_png_reader,      "png_reader"      },
+    { test_mapped_bitmap,   "mapped_bitmap"   },
+    { test_opaque_dst,      "opaque_dst"      },
+    { test_draw_rects,      "draw_rects"      },
+    { test_map_points,      "map_points"      },
+    { test_bitmap_integer_translate, "bitmap_integer_translate" },
+    { test_deferred_save,   "deferred_save"   },
+    { test_instrument,      "instrument"      },
+
     { nullptr, nullptr },
 };
 
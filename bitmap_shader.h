@@ -6,6 +6,8 @@
 #include "include/GMatrix.h"
 #include "include/GPixel.h"
 
+#include <cstring>
+
 using namespace std;
 
 class BitmapShader : public GShader {
@@ -41,17 +43,35 @@ int applyTileMode(GTileMode tileMode, float n, int bound) {
 }
 
 void shadeRow(int x, int y, int count, GPixel row[]) override {
-  GPoint init = {x+0.5, y+0.5};
-  GPoint coord = inverted*init;
-
+  const GMatrix& inv = inverted;
   int width = bm.width();
   int height = bm.height();
 
-  if(inverted[1] == 0) {
+  // drawn 1:1 at a whole-pixel offset and clamped: the row is a run of one bitmap row, with its
+  // end pixels repeated either side of it
+  if(tileMode == GTileMode::kClamp && inv.isIntegerTranslate()) {
+    int sx = x + (int)inv[4];
+    const GPixel* src = bm.getAddr(0, max(0, min(y + (int)inv[5], height-1)));
+    int i = 0;
+    for(; i < count && sx + i < 0; i++) row[i] = src[0];
+    int n = min(count, width - sx) - i;
+    if(n > 0) {
+      memcpy(row + i, src + sx + i, n*sizeof(GPixel));
+      i += n;
+    }
+    for(; i < count; i++) row[i] = src[width-1];
+    return;
+  }
+
+  GPoint init = {x+0.5, y+0.5};
+  GPoint coord = inv*init;
+
+  // every pixel of the row samples the same bitmap row
+  if(inv.isScaleTranslate() || inv[1] == 0) {
     float xx = coord.x;
     int yy = applyTileMode(tileMode, coord.y, height);
 
-    float step = inverted[0];
+    float step = inv[0];
     for(int i = 0; i < count; i++) {
       row[i] = *bm.getAddr(applyTileMode(tileMode, xx, width), yy);
       xx += step; 
@@ -61,8 +81,8 @@ void shadeRow(int x, int y, int count, GPixel row[]) override {
     float xx = coord.x;
     float yy = coord.y;
 
-    float stepx = inverted[0];
-    float stepy = inverted[1];
+    float stepx = inv[0];
+    float stepy = inv[1];
 
     for(int i = 0; i < count; i++) {
       row[i] = *bm.getAddr(applyTileMode(tileMode, xx, width), applyTileMode(tileMode, yy, height));
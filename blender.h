@@ -29,6 +29,21 @@ static inline void bSrcOver(GPixel src, GPixel *dst) {
   *dst = GPixel_PackARGB(a, r, g, b);
 }
 
+// x/255, rounded to nearest, for x in [0, 255*255]
+static inline int div255(int x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+// SrcOver into an opaque dst: the result's alpha is always 255, so only the colors are blended.
+static inline void bSrcOverOpaqueDst(GPixel src, GPixel *dst) {
+  int srcA_inv = 255 - GPixel_GetA(src);
+  int r = GPixel_GetR(src) + div255(srcA_inv*GPixel_GetR(*dst));
+  int g = GPixel_GetG(src) + div255(srcA_inv*GPixel_GetG(*dst));
+  int b = GPixel_GetB(src) + div255(srcA_inv*GPixel_GetB(*dst));
+  *dst = GPixel_PackARGB(255, r, g, b);
+}
+
 static inline void bDstOver(GPixel src, GPixel *dst) {
   float dstA_inv = (255.0f - GPixel_GetA(*dst)) / 255.0f;
   int a = GPixel_GetA(*dst) + (int)(dstA_inv*GPixel_GetA(src) + 0.5f);
@@ -105,3 +120,14 @@ static inline void bXor(GPixel src, GPixel *dst) {
   *dst = GPixel_PackARGB(a, r, g, b);
 }
 
+
+// dst moved coverage/255 of the way towards src, channel by channel
+static inline GPixel lerpPixel(GPixel dst, GPixel src, int coverage) {
+  auto lerp = [coverage](int d, int s) {
+    return (d*(255 - coverage) + s*coverage + 127) / 255;
+  };
+  return GPixel_PackARGB(lerp(GPixel_GetA(dst), GPixel_GetA(src)),
+                         lerp(GPixel_GetR(dst), GPixel_GetR(src)),
+                         lerp(GPixel_GetG(dst), GPixel_GetG(src)),
+                         lerp(GPixel_GetB(dst), GPixel_GetB(src)));
+}
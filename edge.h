@@ -1,4 +1,8 @@
+#ifndef _edge_h_
+#define _edge_h_
+
 #include "include/GPoint.h"
+#include "include/GRect.h"
 #include "include/GMath.h"
 #include <vector>
 
@@ -49,9 +53,13 @@ static inline Edge createEdge(GPoint p0, GPoint p1, int direction) {
   return { m, b, min(p0y, p1y), max(p0y, p1y), direction };
 }
 
-void clipEdge(vector<Edge>& edges, GPoint p0, GPoint p1, int boundBottom, int boundRight) {
-  int boundTop = 0;
-  int boundLeft = 0;
+// Clips the edge p0-p1 to the pixel rect clip. The parts left or right of clip are projected
+// onto its sides, so they still count towards the winding of the rows they span.
+void clipEdge(vector<Edge>& edges, GPoint p0, GPoint p1, const GIRect& clip) {
+  int boundTop = clip.top;
+  int boundBottom = clip.bottom;
+  int boundLeft = clip.left;
+  int boundRight = clip.right;
 
   int direction = p0.y < p1.y ? 1 : -1;
   Edge edge = createEdge(p0, p1, direction);
@@ -76,7 +84,7 @@ void clipEdge(vector<Edge>& edges, GPoint p0, GPoint p1, int boundBottom, int bo
   // left right
   if(p0.x > p1.x) swap(p0, p1);
   if(p1.x < boundLeft) {
-    edge.projectTo(0);
+    edge.projectTo(boundLeft);
     edges.push_back(edge);
     return;
   } else if(p0.x >= boundRight) {
@@ -110,3 +118,4 @@ void clipEdge(vector<Edge>& edges, GPoint p0, GPoint p1, int boundBottom, int bo
   edges.push_back(edge);
 }
 
+#endif
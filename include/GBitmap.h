@@ -7,6 +7,39 @@
 
 #include "GPixel.h"
 
+/**
+ *  How GBitmap::writeToFile compresses. kStore, kRLE and kFast are encoded a row at a time as
+ *  the pixels are read, so they never hold a copy of the image; kDefault and kBest go through
+ *  lodepng, which needs the whole (unpremultiplied) image up front but compresses harder.
+ */
+struct GPNGOptions {
+    enum Compression {
+        kStore,     // no compression: fastest, largest
+        kRLE,       // only runs that repeat the previous byte or pixel, fixed Huffman codes
+        kFast,      // greedy LZ77 with one hash probe per byte, fixed Huffman codes
+        kDefault,   // lodepng's defaults: lazy matching in a 2K window, dynamic Huffman codes
+        kBest,      // lodepng with the full 32K window and the longest matches
+    };
+    enum Filter {
+        kNone_Filter,
+        kSub_Filter,
+        kUp_Filter,
+        kPaeth_Filter,
+        kAdaptive_Filter,   // per row, whichever PNG filter leaves the smallest residuals
+    };
+
+    Compression fCompression = kDefault;
+    Filter      fFilter = kAdaptive_Filter;
+
+    /**
+     *  For kStore, kRLE and kFast, how many threads may compress at once. Above 1, bands of rows
+     *  are deflated independently (each primed with the 32K before it, so matches still reach
+     *  back across the seam) and joined into one stream; each band's output is held until it
+     *  is written. lodepng's modes always use one thread.
+     */
+    int         fThreads = 1;
+};
+
 class GBitmap {
 public:
     GBitmap() { this->reset(); }
@@ -70,13 +103,22 @@ public:
      *  Attempt to write the bitmap as a PNG into a new file (the file will be created/overwritten).
      *  Return true on success.
      */
-    bool writeToFile(const char path[]) const;
+    bool writeToFile(const char path[], const GPNGOptions& = GPNGOptions()) const;
 
     /**
-     *  Allocate the memory for the bitmap. If rowBytes is 0, it will be computed from w.
+     *  Allocate the memory for the bitmap. If rowBytes is 0, it will be computed from w (see
+     *  PreferredRowBytes). The caller must call free(bitmap->pixels()) when they are finished.
      */
     void alloc(int w, int h, size_t rowBytes = 0);
 
+    /**
+     *  Return the rowBytes alloc() uses for width w. This is w * 4 rounded up to a multiple of
+     *  64 (a cache line), plus one more cache line when that lands on a multiple of 1024. Strides
+     *  like 4096 (1024 pixels) put every row of a column in the same few cache sets, so walking
+     *  down a column would evict itself; the extra line staggers the rows across sets.
+     */
+    static size_t PreferredRowBytes(int w);
+
 private:
     int     fWidth;
     int     fHeight;
@@ -14,12 +14,20 @@ class GPath;
 class GPoint;
 class GRect;
 
+/**
+ *  Counters a canvas keeps about the draw calls it is given.
+ */
+struct GCanvasStats {
+    int fDraws = 0;             // draw calls, not counting clear()
+    int fRejectedDraws = 0;     // ...of which, ones skipped as lying entirely outside the clip
+};
+
 class GCanvas {
 public:
     virtual ~GCanvas() {}
 
     /**
-     *  Save off a copy of the canvas state (CTM), to be later used if the balancing call to
+     *  Save off a copy of the canvas state (CTM and clip), to be later used if the balancing call to
      *  restore() is made. Calls to save/restore can be nested:
      *  save();
      *      save();
@@ -32,7 +40,16 @@ public:
     virtual void save() = 0;
 
     /**
-     *  Copy the canvas state (CTM) that was record in the correspnding call to save() back into
+     *  Like save(), but also redirect drawing into a new offscreen layer until the balancing
+     *  restore(). The layer covers bounds (mapped by the CTM), or the whole clip if bounds is
+     *  null, intersected with the clip, and starts out transparent. restore() then draws the
+     *  layer onto the canvas (or the enclosing layer) with the paint's alpha and blend mode,
+     *  ignoring its color and shader. A null paint composites with kSrcOver at full alpha.
+     */
+    virtual void saveLayer(const GRect* bounds, const GPaint* paint) = 0;
+
+    /**
+     *  Copy the canvas state (CTM and clip) that was record in the correspnding call to save() back into
      *  the canvas. It is an error to call restore() if there has been no previous call to save().
      */
     virtual void restore() = 0;
@@ -46,7 +63,44 @@ public:
     virtual void concat(const GMatrix& matrix) = 0;
 
     /**
-     *  Fill the entire canvas with the specified color, using kSrc porter-duff mode.
+     *  Intersect the clip with the rectangle, mapped by the CTM. Later drawing (until the
+     *  matching restore()) only touches pixels inside the clip. The canvas is constructed with
+     *  the clip set to the whole device. Pixels follow the same "containment" rule as drawRect.
+     */
+    virtual void clipRect(const GRect&) = 0;
+
+    /**
+     *  Intersect the clip with the path (non-zero winding), mapped by the CTM. Pixels follow the
+     *  same "containment" rule as drawPath.
+     */
+    virtual void clipPath(const GPath&) = 0;
+
+    /**
+     *  Return true if the rect, mapped by the CTM, lies entirely outside the clip, so drawing
+     *  inside it cannot change any pixels. Returning false does not promise that it would.
+     */
+    virtual bool quickReject(const GRect&) const = 0;
+
+    /**
+     *  Return the counters for the draw calls made since the canvas was created, or since the
+     *  last call to resetStats(). Draws call quickReject on their own bounds before doing any
+     *  other work.
+     */
+    virtual GCanvasStats stats() const = 0;
+    virtual void resetStats() = 0;
+
+    /**
+     *  Return the device pixels that drawing may have changed since the canvas was created, or
+     *  since the last call to resetDirty(), as one bounding rect (empty if nothing was drawn).
+     *  It is conservative: every changed pixel is inside it, but not every pixel inside it need
+     *  have changed. Hosts can use it to upload (or re-render) just that part of the device.
+     */
+    virtual GIRect dirtyBounds() const = 0;
+    virtual void resetDirty() = 0;
+
+    /**
+     *  Fill the entire canvas (or the current layer, see saveLayer) with the specified color,
+     *  using kSrc porter-duff mode. This ignores the clip.
      */
     virtual void clear(const GColor&) = 0;
 
@@ -58,6 +112,18 @@ public:
      */
     virtual void drawRect(const GRect&, const GPaint&) = 0;
 
+    /**
+     *  Draw count rects, in order, the i-th with paints[i]: the same pixels as calling drawRect
+     *  for each, but the batch is mapped by the CTM (and checked against the clip) in one pass,
+     *  so a UI drawing thousands of rects pays the per-call setup once.
+     */
+    virtual void drawRects(const GRect rects[], const GPaint paints[], int count) = 0;
+
+    /**
+     *  Draw count rects, in order, all with the same paint.
+     */
+    virtual void drawRects(const GRect rects[], int count, const GPaint&) = 0;
+
     /**
      *  Fill the convex polygon with the color and blendmode,
      *  following the same "containment" rule as rectangles.
@@ -69,6 +135,16 @@ public:
      */
     virtual void drawPath(const GPath&, const GPaint&) = 0;
 
+    /**
+     *  Draw count 1-pixel-wide lines, the i-th one from pts[2*i] to pts[2*i + 1]. The points are
+     *  mapped by the CTM, but the lines stay 1 pixel wide whatever the CTM's scale.
+     *
+     *  Without antialiasing, each line touches one pixel per column (or per row, if it is
+     *  steeper than 45 degrees), for the columns whose centers lie between its end points. With
+     *  antialiasing, that coverage is split between the two nearest pixels in the column.
+     */
+    virtual void drawHairlines(const GPoint pts[], int count, const GPaint&, bool antialias) = 0;
+
     /**
      *  Draw a mesh of triangles, with optional colors and/or texture-coordinates at each vertex.
      *
@@ -144,6 +220,11 @@ public:
     void fillRect(const GRect& rect, const GColor& color) {
         this->drawRect(rect, GPaint(color));
     }
+
+    void drawLine(GPoint p0, GPoint p1, const GPaint& paint, bool antialias = false) {
+        const GPoint pts[] = { p0, p1 };
+        this->drawHairlines(pts, 1, paint, antialias);
+    }
 };
 
 /**
@@ -0,0 +1,100 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#ifndef GInstrument_DEFINED
+#define GInstrument_DEFINED
+
+#include "GBlendMode.h"
+#include <cstdint>
+#include <cstdio>
+
+/**
+ *  Opt-in counters and timings for the canvas, to see where rendering time goes. Build with
+ *  -DG_INSTRUMENT (see the Makefile's itests and ibench) to turn them on. Without it the hooks
+ *  the canvas calls (the G_INSTRUMENT_... macros) compile to nothing, GInstrument::kEnabled is
+ *  false and the reports come out all zero.
+ *
+ *  Counting is per thread, for the frame begun by the last BeginFrame() on that thread.
+ */
+enum class GPrimitive {
+    kClear,
+    kRect,
+    kConvexPolygon,
+    kPath,
+    kHairlines,
+    kMesh,
+    kQuad,
+    kLayer,     // compositing a saveLayer on restore()
+};
+static constexpr int kGPrimitiveCount = (int)GPrimitive::kLayer + 1;
+static constexpr int kGBlendModeCount = (int)GBlendMode::kXor + 1;
+
+struct GFrameCounters {
+    struct Primitive {
+        int64_t fCalls = 0;
+        int64_t fSpans = 0;     // runs of pixels blended
+        int64_t fPixels = 0;    // pixels blended, over all the spans
+        int64_t fNanos = 0;     // wall time inside the draw calls
+    };
+    Primitive   fPrimitives[kGPrimitiveCount];
+    int64_t     fBlendedPixels[kGBlendModeCount] = {};  // by the paint's GBlendMode
+    int64_t     fEdges = 0;     // edges built to scan convert paths
+    int64_t     fCurves = 0;    // quads and cubics flattened into lines
+};
+
+class GInstrument {
+public:
+#ifdef G_INSTRUMENT
+    static constexpr bool kEnabled = true;
+#else
+    static constexpr bool kEnabled = false;
+#endif
+
+    /**
+     *  Clear the counters and the trace, starting a new frame.
+     */
+    static void BeginFrame();
+
+    static const GFrameCounters& Counters();
+
+    /**
+     *  Write the frame's counters as a JSON object. Return true on success.
+     */
+    static bool WriteJSON(FILE*);
+
+    /**
+     *  Write the frame's draw calls in Chrome's trace_event format (load the file in
+     *  chrome://tracing or Perfetto): one complete ("X") event per call. Return true on success.
+     */
+    static bool WriteTrace(FILE*);
+
+    // Hooks, called through the macros below.
+    static void BeginDraw(GPrimitive);
+    static void EndDraw();
+    static void CountSpan(GBlendMode, int pixels);
+    static void CountEdges(int);
+    static void CountCurves(int);
+};
+
+#ifdef G_INSTRUMENT
+// Times and counts the enclosing draw call. A draw made by another (drawRects falling back to
+// drawRect, say) is part of the outer one.
+class GInstrumentScope {
+public:
+    explicit GInstrumentScope(GPrimitive primitive) { GInstrument::BeginDraw(primitive); }
+    ~GInstrumentScope() { GInstrument::EndDraw(); }
+};
+
+#define G_INSTRUMENT_DRAW(primitive)    GInstrumentScope gInstrumentScope_(primitive)
+#define G_INSTRUMENT_SPAN(mode, count)  GInstrument::CountSpan(mode, count)
+#define G_INSTRUMENT_EDGES(count)       GInstrument::CountEdges(count)
+#define G_INSTRUMENT_CURVES(count)      GInstrument::CountCurves(count)
+#else
+#define G_INSTRUMENT_DRAW(primitive)    do {} while (0)
+#define G_INSTRUMENT_SPAN(mode, count)  do {} while (0)
+#define G_INSTRUMENT_EDGES(count)       do {} while (0)
+#define G_INSTRUMENT_CURVES(count)      do {} while (0)
+#endif
+
+#endif
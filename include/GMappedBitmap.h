@@ -0,0 +1,61 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#ifndef GMappedBitmap_DEFINED
+#define GMappedBitmap_DEFINED
+
+#include "GBitmap.h"
+
+/**
+ *  A bitmap whose pixels are a read-only memory map of a raw image file, so "loading" one is an
+ *  mmap: no decode, no copy, and pages are only read in as they are touched.
+ *
+ *  The raw format is a 64 byte header followed by the rows exactly as GBitmap holds them:
+ *  premultiplied GPixels, rowBytes apart (GBitmap::PreferredRowBytes(width)), so every row
+ *  starts on a cache line. The header records the size, rowBytes and whether the pixels are all
+ *  opaque, plus a sample pixel so a file written with a different GPixel layout is rejected.
+ *
+ *  Moving transfers the mapping; it is unmapped when destroyed (or reset).
+ */
+class GMappedBitmap {
+public:
+    GMappedBitmap() {}
+    GMappedBitmap(GMappedBitmap&&);
+    GMappedBitmap& operator=(GMappedBitmap&&);
+    ~GMappedBitmap() { this->reset(); }
+
+    GMappedBitmap(const GMappedBitmap&) = delete;
+    GMappedBitmap& operator=(const GMappedBitmap&) = delete;
+
+    /**
+     *  Map the raw image at path. On failure (missing, truncated or not a raw image) the result
+     *  is empty: its bitmap has no pixels.
+     */
+    static GMappedBitmap Map(const char path[]);
+
+    /**
+     *  Write the bitmap in the raw format into a new file (created/overwritten). Return true on
+     *  success.
+     */
+    static bool Write(const GBitmap&, const char path[]);
+
+    /**
+     *  The pixels are read-only: drawing into them will fault.
+     */
+    const GBitmap& bitmap() const { return fBitmap; }
+    const GBitmap* operator->() const { return &fBitmap; }
+    const GBitmap& operator*() const { return fBitmap; }
+
+    /**
+     *  Unmap the file and become empty.
+     */
+    void reset();
+
+private:
+    GBitmap fBitmap;
+    void*   fBase = nullptr;
+    size_t  fLength = 0;
+};
+
+#endif
@@ -20,11 +20,13 @@ public:
     GMatrix(float a, float c, float e, float b, float d, float f) {
         fMat[0] = a;    fMat[2] = c;    fMat[4] = e;
         fMat[1] = b;    fMat[3] = d;    fMat[5] = f;
+        fTypeMask = this->computeTypeMask();
     }
 
     GMatrix(GVector e0, GVector e1, GVector origin) {
         fMat[0] = e0.x;    fMat[2] = e1.x;    fMat[4] = origin.x;
         fMat[1] = e0.y;    fMat[3] = e1.y;    fMat[5] = origin.y;
+        fTypeMask = this->computeTypeMask();
     }
 
     GMatrix(const GMatrix& other) = default;
@@ -37,11 +39,66 @@ public:
         assert(index >= 0 && index < 6);
         return fMat[index];
     }
-    float& operator[](int index) {
+
+    /**
+     *  Change one entry, reclassifying the matrix (see getType).
+     */
+    void set(int index, float value) {
         assert(index >= 0 && index < 6);
-        return fMat[index];
+        fMat[index] = value;
+        fTypeMask = this->computeTypeMask();
     }
 
+    /**
+     *  A writable entry of a non-const matrix. It reads as a float, and assigning to it goes
+     *  through set(), so the type stays in step; plain reads don't disturb it.
+     */
+    class Entry {
+    public:
+        operator float() const { return fMatrix->fMat[fIndex]; }
+
+        Entry& operator=(float value) { fMatrix->set(fIndex, value); return *this; }
+        Entry& operator=(const Entry& other) { return *this = (float)other; }
+        Entry& operator+=(float value) { return *this = (float)*this + value; }
+        Entry& operator-=(float value) { return *this = (float)*this - value; }
+        Entry& operator*=(float value) { return *this = (float)*this * value; }
+        Entry& operator/=(float value) { return *this = (float)*this / value; }
+
+    private:
+        Entry(GMatrix* matrix, int index) : fMatrix(matrix), fIndex(index) {}
+
+        GMatrix* fMatrix;
+        int      fIndex;
+
+        friend class GMatrix;
+    };
+
+    Entry operator[](int index) {
+        assert(index >= 0 && index < 6);
+        return Entry(this, index);
+    }
+
+    /**
+     *  The kind of transform, as a combination of these bits; 0 is the identity. Computed when
+     *  the matrix is made (so by Concat, invert, ...) or changed (set(), or assigning through
+     *  operator[]), and cached, so fast paths can ask for it freely.
+     */
+    enum TypeMask {
+        kIdentity_Mask   = 0,
+        kTranslate_Mask  = 1 << 0,  // e or f is not 0
+        kScale_Mask      = 1 << 1,  // a or d is not 1
+        kAffine_Mask     = 1 << 2,  // b or c is not 0: it skews or rotates
+        kFractional_Mask = 1 << 3,  // e or f is not a whole number (with kTranslate_Mask)
+    };
+    unsigned getType() const { return fTypeMask; }
+
+    bool isIdentity() const { return this->getType() == kIdentity_Mask; }
+    bool isTranslate() const {
+        return (this->getType() & ~(kTranslate_Mask | kFractional_Mask)) == 0;
+    }
+    bool isIntegerTranslate() const { return (this->getType() & ~kTranslate_Mask) == 0; }
+    bool isScaleTranslate() const { return (this->getType() & kAffine_Mask) == 0; }
+
     bool operator==(const GMatrix& m) {
         for (int i = 0; i < 6; ++i) {
             if (fMat[i] != m.fMat[i]) {
@@ -103,7 +160,25 @@ public:
     }
 
 private:
-    float fMat[6];
+    float   fMat[6];
+    uint8_t fTypeMask;
+
+    unsigned computeTypeMask() const {
+        unsigned mask = kIdentity_Mask;
+        if (fMat[4] != 0 || fMat[5] != 0) {
+            mask |= kTranslate_Mask;
+            if (floorf(fMat[4]) != fMat[4] || floorf(fMat[5]) != fMat[5]) {
+                mask |= kFractional_Mask;
+            }
+        }
+        if (fMat[0] != 1 || fMat[3] != 1) {
+            mask |= kScale_Mask;
+        }
+        if (fMat[1] != 0 || fMat[2] != 0) {
+            mask |= kAffine_Mask;
+        }
+        return mask;
+    }
 };
 
 #endif
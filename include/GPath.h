@@ -5,14 +5,23 @@
 #ifndef GPath_DEFINED
 #define GPath_DEFINED
 
+#include <memory>
 #include <vector>
 #include "GMatrix.h"
 #include "GPoint.h"
 #include "GRect.h"
 
+struct GPathFlatCache;
+
+/**
+ *  Drawing a non-volatile path may cache its flattened edges in it (see setIsVolatile), so even
+ *  a const path must not be drawn on two threads at once. Give each thread its own copy (copies
+ *  don't share the cache), or mark the path volatile.
+ */
 class GPath {
 public:
     GPath();
+    GPath(const GPath&);
     ~GPath();
 
     GPath& operator=(const GPath&);
@@ -27,6 +36,7 @@ public:
      *  Returns a reference to this path.
      */
     void moveTo(GPoint p) {
+        this->invalidate();
         fPts.push_back(p);
         fVbs.push_back(kMove);
     }
@@ -39,6 +49,7 @@ public:
      */
     void lineTo(GPoint p) {
         assert(fVbs.size() > 0);
+        this->invalidate();
         fPts.push_back(p);
         fVbs.push_back(kLine);
     }
@@ -95,6 +106,12 @@ public:
      */
     GRect bounds() const;
 
+    /**
+     *  Return the bounds of all of the points, including the off-curve control points. This
+     *  always contains bounds(), and is much cheaper since no curve extrema are solved for.
+     */
+    GRect controlBounds() const;
+
     /**
      *  Transform the path in-place by the specified matrix.
      */
@@ -178,9 +195,36 @@ public:
 
     void dump() const;
 
+    /**
+     *  Volatile paths are never cached by the canvas (e.g. a path rebuilt for every draw).
+     *  Paths are non-volatile by default: the canvas caches a path's flattened edges once it
+     *  has been drawn twice under the same scale/skew.
+     */
+    bool isVolatile() const { return fIsVolatile; }
+    void setIsVolatile(bool isVolatile) {
+        fIsVolatile = isVolatile;
+        this->invalidate();
+    }
+
 private:
     std::vector<GPoint> fPts;
     std::vector<Verb>   fVbs;
+    bool                fIsVolatile = false;
+
+    // The canvas's cache of the flattened edges, and the scale/skew of the last draw that
+    // didn't use it (src/GPathPriv.h). Any edit discards both.
+    mutable std::unique_ptr<GPathFlatCache> fFlat;
+    mutable float       fLastScaleSkew[4] = {};
+    mutable bool        fDrawn = false;
+
+    void invalidate() {
+        if (fFlat || fDrawn) {
+            this->discardCache();
+        }
+    }
+    void discardCache();
+
+    friend class GPathPriv;
 };
 
 #endif
@@ -0,0 +1,61 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#ifndef GStroke_DEFINED
+#define GStroke_DEFINED
+
+#include <vector>
+#include "GPath.h"
+
+/**
+ *  Parameters for turning the outline of a path into a fillable stroke.
+ */
+struct GStroke {
+    enum Join {
+        kMiter_Join,    // extend the outer edges to a point (falls back to bevel past fMiterLimit)
+        kRound_Join,    // arc of radius width/2 around the corner
+        kBevel_Join,    // connect the outer edges with a straight line
+    };
+    enum Cap {
+        kButt_Cap,      // stop flush at the end point
+        kRound_Cap,     // half-circle of radius width/2 past the end point
+        kSquare_Cap,    // half-square of width/2 past the end point
+    };
+
+    float   fWidth = 1;      // widths <= 0 stroke to an empty path
+    Join    fJoin = kMiter_Join;
+    Cap     fCap = kButt_Cap;
+
+    /**
+     *  Largest ratio of miter length to stroke width before a miter join becomes a bevel.
+     */
+    float   fMiterLimit = 4;
+
+    /**
+     *  Stroke every contour as closed, joining its last point back to its first. Contours whose
+     *  last point equals their first are always treated as closed.
+     */
+    bool    fClosed = false;
+
+    /**
+     *  Alternating on/off lengths along each contour, starting fDashPhase into the pattern.
+     *  Empty (or all zero) draws a solid stroke.
+     */
+    std::vector<float>  fDashes;
+    float               fDashPhase = 0;
+
+    /**
+     *  Device pixels per path unit. Curves and round joins/caps are subdivided until they are
+     *  within 1/4 of a device pixel, so pass the scale the result will be drawn at.
+     */
+    float   fResScale = 1;
+};
+
+/**
+ *  Return a path that covers the stroke of src when drawn with GCanvas::drawPath. Every contour
+ *  of the result winds clockwise, so overlapping pieces union under non-zero filling.
+ */
+GPath GStrokePath(const GPath& src, const GStroke&);
+
+#endif
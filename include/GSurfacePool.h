@@ -0,0 +1,98 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#ifndef GSurfacePool_DEFINED
+#define GSurfacePool_DEFINED
+
+#include "GBitmap.h"
+
+#include <unordered_map>
+#include <vector>
+
+class GSurfacePool;
+
+/**
+ *  Pixel rows from GSurfacePool (and GOwnedBitmap::Alloc) start on this boundary, so a row's
+ *  first pixel is always the start of a cache line. Their rowBytes is
+ *  GBitmap::PreferredRowBytes(width), which is always a multiple of it.
+ */
+static constexpr size_t kGSurfaceAlignment = 64;
+
+/**
+ *  Owns the pixel memory of a bitmap. When it is destroyed (or reset) the memory goes back to the
+ *  pool it came from, or is freed if it has no pool. Moving transfers ownership.
+ */
+class GOwnedBitmap {
+public:
+    GOwnedBitmap() {}
+    GOwnedBitmap(GOwnedBitmap&&);
+    GOwnedBitmap& operator=(GOwnedBitmap&&);
+    ~GOwnedBitmap() { this->reset(); }
+
+    GOwnedBitmap(const GOwnedBitmap&) = delete;
+    GOwnedBitmap& operator=(const GOwnedBitmap&) = delete;
+
+    /**
+     *  Allocate an aligned, zeroed bitmap that is not tied to any pool.
+     */
+    static GOwnedBitmap Alloc(int w, int h);
+
+    const GBitmap& bitmap() const { return fBitmap; }
+    const GBitmap* operator->() const { return &fBitmap; }
+    const GBitmap& operator*() const { return fBitmap; }
+
+    /**
+     *  Release the pixels (back to the pool, if any) and become empty.
+     */
+    void reset();
+
+private:
+    GBitmap         fBitmap;
+    GSurfacePool*   fPool = nullptr;
+
+    friend class GSurfacePool;
+};
+
+/**
+ *  Recycles bitmap memory by dimensions. A bitmap released back to the pool is handed out again
+ *  by the next alloc() of the same width and height, so code that creates many short-lived
+ *  offscreens of a few sizes stops paying for fresh (page-faulting) allocations.
+ *
+ *  The pool must outlive every GOwnedBitmap it hands out.
+ */
+class GSurfacePool {
+public:
+    /**
+     *  At most maxFreePerSize released buffers are kept for each width/height; the rest are freed.
+     */
+    explicit GSurfacePool(int maxFreePerSize = 4) : fMaxFreePerSize(maxFreePerSize) {}
+    ~GSurfacePool();
+
+    GSurfacePool(const GSurfacePool&) = delete;
+    GSurfacePool& operator=(const GSurfacePool&) = delete;
+
+    /**
+     *  Return a bitmap of w x h with rowBytes == GBitmap::PreferredRowBytes(w). If zero is true
+     *  its pixels are all 0, otherwise recycled memory keeps whatever it last held.
+     */
+    GOwnedBitmap alloc(int w, int h, bool zero = true);
+
+    /**
+     *  Free every buffer the pool is holding for reuse.
+     */
+    void purge();
+
+    int liveCount() const { return fLive; }
+
+private:
+    std::unordered_map<uint64_t, std::vector<GPixel*>> fFree;
+    const int   fMaxFreePerSize;
+    int         fLive = 0;
+
+    void release(GBitmap*);
+
+    friend class GOwnedBitmap;
+};
+
+#endif
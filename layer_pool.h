@@ -0,0 +1,36 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#ifndef _layer_pool_h_
+#define _layer_pool_h_
+
+#include "include/GSurfacePool.h"
+
+// Recycles the pixel memory behind saveLayer's offscreen layers. Sizes are rounded up to powers
+// of two (at least kMinBucket) before going to the surface pool, so layers of similar size share
+// buffers from frame to frame and steady-state drawing doesn't allocate.
+class LayerPool {
+public:
+  LayerPool() : pool(kMaxFreePerBucket) {}
+
+  // The surface is at least w x h and its pixels are left as they were; the layer clears what
+  // it uses. Dropping (or resetting) the surface hands it back.
+  GOwnedBitmap acquire(int w, int h) {
+    return pool.alloc(bucketSize(w), bucketSize(h), false);
+  }
+
+private:
+  static const int kMinBucket = 64;
+  static const int kMaxFreePerBucket = 4;
+
+  GSurfacePool pool;
+
+  static int bucketSize(int n) {
+    int size = kMinBucket;
+    while(size < n) size <<= 1;
+    return size;
+  }
+};
+
+#endif
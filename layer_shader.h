@@ -0,0 +1,48 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#ifndef _layer_shader_h_
+#define _layer_shader_h_
+
+#include "include/GShader.h"
+#include "include/GBitmap.h"
+#include "include/GPixel.h"
+
+// Reads back a saveLayer layer, whose top-left sits at (left, top) in device space, scaled by
+// the layer paint's alpha. Used to composite the layer with the regular span blitters.
+class LayerShader : public GShader {
+public:
+  LayerShader(const GBitmap& layer, int left, int top, float alpha)
+    : layer(layer), left(left), top(top), scale(GRoundToInt(alpha * 256)) {}
+
+  bool isOpaque() override {
+    return false;
+  }
+
+  bool setContext(const GMatrix& ctm) override {
+    return true;  // already in device space
+  }
+
+  void shadeRow(int x, int y, int count, GPixel row[]) override {
+    const GPixel* src = layer.getAddr(x - left, y - top);
+    if(scale >= 256) {
+      std::copy(src, src + count, row);
+      return;
+    }
+    for(int i = 0; i < count; i++) {
+      GPixel p = src[i];
+      row[i] = GPixel_PackARGB((GPixel_GetA(p) * scale + 128) >> 8,
+                               (GPixel_GetR(p) * scale + 128) >> 8,
+                               (GPixel_GetG(p) * scale + 128) >> 8,
+                               (GPixel_GetB(p) * scale + 128) >> 8);
+    }
+  }
+
+private:
+  GBitmap layer;
+  int left, top;
+  int scale;  // alpha in 1/256ths
+};
+
+#endif
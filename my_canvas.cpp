@@ -4,6 +4,8 @@
 
 #include "my_canvas.h"
 #include "edge.h"
+#include "include/GInstrument.h"
+#include "src/GPathPriv.h"
 
 #include <algorithm>
 #include <iostream>
@@ -26,29 +28,120 @@ const int gProcs[][3] = {
   { 11, 2, 7 }    // bXor
 };
 
+// gProcs when every dst pixel is known to be opaque (Da = 1): DstOver leaves dst alone, SrcIn
+// is Src, SrcOut clears, SrcATop is SrcOver, DstATop is DstIn and Xor is DstOut. SrcOver uses
+// 12, which skips the alpha math since the result stays opaque.
+const int gOpaqueDstProcs[][3] = {
+  { 0, 0, 0 },    // bClear
+  { 1, 0, 1 },    // bSrc
+  { 2, 2, 2 },    // bDst
+  { 12, 2, 1 },   // bSrcOver
+  { 2, 2, 2 },    // bDstOver
+  { 1, 0, 1 },    // bSrcIn
+  { 6, 0, 2 },    // bDstIn
+  { 0, 0, 0 },    // bSrcOut
+  { 8, 2, 0 },    // bDstOut
+  { 12, 2, 1 },   // bSrcATop
+  { 6, 0, 2 },    // bDstATop
+  { 8, 2, 0 }     // bXor
+};
+
+// the single-pixel procs behind each entry of gProcs
+typedef void (*BlendProc)(GPixel, GPixel*);
+const BlendProc gBlendProcs[] = {
+  bClear, bSrc, bDst, bSrcOver, bDstOver, bSrcIn,
+  bDstIn, bSrcOut, bDstOut, bSrcATop, bDstATop, bXor,
+  bSrcOverOpaqueDst
+};
+
+// Whether proc, applied to an opaque dst with a source from column sa, leaves it opaque.
+static bool keepsOpaque(int proc, int sa) {
+  return proc == 2 || proc == 12 || (proc == 1 && sa == 2);
+}
+
+// The proc for blendMode and sa when drawing into the current layer (or device). Once a proc
+// could leave a pixel translucent, the target is no longer known to be opaque.
+int MyCanvas::chooseProc(int blendMode, int sa) {
+  if(!canvas.isOpaque()) {
+    return gProcs[blendMode][sa];
+  }
+  int proc = gOpaqueDstProcs[blendMode][sa];
+  if(!keepsOpaque(proc, sa)) {
+    canvas.setIsOpaque(GBitmap::kNo_IsOpaque);
+  }
+  return proc;
+}
+
+// save() only counts on the top state; the copy waits until something would change it.
 void MyCanvas::save() {
-  ctmStack.push(ctmStack.top());
+  stateStack.back().deferredSaves++;
 }
 
 void MyCanvas::restore() {
-  ctmStack.pop();
+  CanvasState& top = stateStack.back();
+  if(top.deferredSaves > 0) {
+    top.deferredSaves--;
+    return;
+  }
+  bool isLayer = top.isLayer;
+  stateStack.pop_back();
+  if(isLayer) {
+    compositeLayer();
+  }
+}
+
+// The top state, ready to be changed: if saves are waiting on it, one of them becomes a copy
+// on the stack, which the matching restore() will pop.
+CanvasState& MyCanvas::writableState() {
+  CanvasState& top = stateStack.back();
+  if(top.deferredSaves == 0) {
+    return top;
+  }
+  top.deferredSaves--;
+  stateStack.push_back(top);  // copies top before any reallocation moves it
+  CanvasState& copy = stateStack.back();
+  copy.deferredSaves = 0;
+  copy.isLayer = false;
+  return copy;
 }
 
 void MyCanvas::concat(const GMatrix& matrix) { 
-  GMatrix a = ctmStack.top();
-  ctmStack.pop();
-  ctmStack.push(GMatrix::Concat(a, matrix));
+  if(matrix.isIdentity()) return;
+  GMatrix& ctm = writableState().ctm;
+  ctm = GMatrix::Concat(ctm, matrix);
 }
 
 template<typename Proc>
 void MyCanvas::fillRow(int x, int y, int count, GPixel row[], Proc blend) {
   for(int i = 0; i < count; i++) {
-    GPixel* dst = canvas.getAddr(x+i, y);
+    GPixel* dst = pixelAddr(x+i, y);
     blend(row[i], dst);
   }
 }
 
+// Spans arrive already clipped to the clip bounds; a clip mask further splits them into the
+// runs it covers.
 void MyCanvas::optimizeBlend(int x, int y, int count, const GPaint& paint) {
+  const ClipMask* mask = currentState().mask.get();
+  if(!mask) {
+    blendRow(x, y, count, paint);
+    return;
+  }
+
+  const uint8_t* coverage = mask->row(y) - mask->bounds.left;
+  int end = x + count;
+  while(x < end) {
+    while(x < end && !coverage[x]) x++;
+    int start = x;
+    while(x < end && coverage[x]) x++;
+    if(x > start) {
+      blendRow(start, y, x - start, paint);
+    }
+  }
+}
+
+void MyCanvas::blendRow(int x, int y, int count, const GPaint& paint) {
+  G_INSTRUMENT_SPAN(paint.getBlendMode(), count);
   GPixel row[count];
   GPixel src = premul(paint.getColor());
   GShader* shader_ptr = paint.getShader();
@@ -59,14 +152,14 @@ void MyCanvas::optimizeBlend(int x, int y, int count, const GPaint& paint) {
 
 
   if(shader_ptr) {
-    if(!shader_ptr->setContext(ctmStack.top())) return;
+    if(!shader_ptr->setContext(currentState().ctm)) return;
     shader_ptr->shadeRow(x, y, count, row);
     sa = (shader_ptr->isOpaque()) ? 2 : 0;
   } else {
     std::fill(row, row+count, src);
   }
 
-  int blendOptimal = gProcs[blendMode][(int)sa];
+  int blendOptimal = chooseProc(blendMode, (int)sa);
 
   switch (blendOptimal) {
     case 0:
@@ -104,14 +197,90 @@ void MyCanvas::optimizeBlend(int x, int y, int count, const GPaint& paint) {
     case 11:
       fillRow(x, y, count, row, bXor);
       break;
+    case 12:
+      fillRow(x, y, count, row, bSrcOverOpaqueDst);
+      break;
+  }
+}
+
+static GRect pointBounds(const GPoint pts[], int count) {
+  float left = pts[0].x, top = pts[0].y, right = pts[0].x, bottom = pts[0].y;
+  for(int i = 1; i < count; i++) {
+    left = min(left, pts[i].x);
+    top = min(top, pts[i].y);
+    right = max(right, pts[i].x);
+    bottom = max(bottom, pts[i].y);
+  }
+  return GRect::LTRB(left, top, right, bottom);
+}
+
+static GRect mapRect(const GMatrix& ctm, const GRect& rect) {
+  GPoint corners[4] = {
+    { rect.left, rect.top },
+    { rect.right, rect.top },
+    { rect.right, rect.bottom },
+    { rect.left, rect.bottom }
+  };
+  ctm.mapPoints(corners, 4);
+  return pointBounds(corners, 4);
+}
+
+static GIRect intersect(const GIRect& a, const GIRect& b) {
+  GIRect r = GIRect::LTRB(max(a.left, b.left), max(a.top, b.top),
+                          min(a.right, b.right), min(a.bottom, b.bottom));
+  return r.isEmpty() ? GIRect::LTRB(0, 0, 0, 0) : r;
+}
+
+// Rounds out, so every pixel whose center is inside rect is inside the result.
+static GIRect roundOut(const GRect& rect) {
+  return GIRect::LTRB((int)floorf(rect.left), (int)floorf(rect.top),
+                      (int)ceilf(rect.right), (int)ceilf(rect.bottom));
+}
+
+static bool missesClip(const GRect& bounds, const GIRect& clip) {
+  return clip.isEmpty() ||
+         bounds.right <= clip.left || bounds.left >= clip.right ||
+         bounds.bottom <= clip.top || bounds.top >= clip.bottom;
+}
+
+bool MyCanvas::quickReject(const GRect& rect) const {
+  const CanvasState& state = currentState();
+  return missesClip(mapRect(state.ctm, rect), state.clip);
+}
+
+// Counts a draw, and whether its device bounds let it be skipped outright. A draw that goes
+// ahead marks its (clipped) bounds dirty.
+bool MyCanvas::rejectDraw(const GRect& deviceBounds) {
+  drawStats.fDraws++;
+  const GIRect& clip = currentState().clip;
+  if(missesClip(deviceBounds, clip)) {
+    drawStats.fRejectedDraws++;
+    return true;
+  }
+  markDirty(intersect(roundOut(deviceBounds), clip));
+  return false;
+}
+
+// Only the device's pixels count: drawing into a layer is picked up when the outermost layer
+// is composited.
+void MyCanvas::markDirty(const GIRect& area) {
+  if(!layers.empty() || area.isEmpty()) return;
+  if(dirty.isEmpty()) {
+    dirty = area;
+  } else {
+    dirty = GIRect::LTRB(min(dirty.left, area.left), min(dirty.top, area.top),
+                         max(dirty.right, area.right), max(dirty.bottom, area.bottom));
   }
 }
 
 void MyCanvas::clear(const GColor& color) {
+  G_INSTRUMENT_DRAW(GPrimitive::kClear);
   int width = canvas.width();
   int height = canvas.height();
 
   GPixel c = premul(color);
+  markDirty(GIRect::XYWH(canvasLeft, canvasTop, width, height));
+  canvas.setIsOpaque(GPixel_GetA(c) == 0xFF ? GBitmap::kYes_IsOpaque : GBitmap::kNo_IsOpaque);
 
   for(int y = 0; y < height; y++) {
     for(int x = 0; x < width; x++) {
@@ -123,149 +292,383 @@ void MyCanvas::clear(const GColor& color) {
 
 
 void MyCanvas::drawRect(const GRect& rect, const GPaint& paint) {
-  GMatrix ctm = ctmStack.top();
-
-  float x1 = rect.x();
-  float y1 = rect.y();
-  float x2 = x1 + rect.width();
-  float y2 = y1 + rect.height();
+  G_INSTRUMENT_DRAW(GPrimitive::kRect);
+  const GMatrix& ctm = currentState().ctm;
+  if(rejectDraw(mapRect(ctm, rect))) return;
 
   GPoint rectPoints[4] = {
-    { x1, y1 },
-    { x2, y1 }, 
-    { x2, y2 },
-    { x1, y2 }
+    { rect.left, rect.top },
+    { rect.right, rect.top },
+    { rect.right, rect.bottom },
+    { rect.left, rect.bottom }
   };
 
-  if(ctm[1] == 0 && ctm[2] == 0) {
-    GPoint lt = ctm*rectPoints[0];
-    GPoint rb = ctm*rectPoints[2];
+  if(ctm.isScaleTranslate()) {
+    // a negative scale mirrors the rect, swapping its sides
+    GPoint a = ctm*rectPoints[0], b = ctm*rectPoints[2];
+    fillDeviceRect({ min(a.x, b.x), min(a.y, b.y) }, { max(a.x, b.x), max(a.y, b.y) }, paint);
+  } else {
+    fillConvexPolygon(rectPoints, 4, paint);
+  }
+}
 
-    int x = max(0, GRoundToInt(lt.x));
-    int right = min(GRoundToInt(rb.x), canvas.width());
-    int count = max(0, right - x);
+// Fills the pixels whose centers lie between lt and rb, the mapped corners of a rect under an
+// axis-aligned CTM, sorted so lt is the top left.
+void MyCanvas::fillDeviceRect(GPoint lt, GPoint rb, const GPaint& paint) {
+  const GIRect& clip = currentState().clip;
+  int x = max(clip.left, GRoundToInt(lt.x));
+  int right = min(GRoundToInt(rb.x), clip.right);
+  int count = max(0, right - x);
 
-    int top = max(0, GRoundToInt(lt.y));
-    int bottom = min(GRoundToInt(rb.y), canvas.height());
+  int top = max(clip.top, GRoundToInt(lt.y));
+  int bottom = min(GRoundToInt(rb.y), clip.bottom);
 
-    for(int y = top; y < bottom; y++) {
-      optimizeBlend(x, y, count, paint);
+  for(int y = top; y < bottom; y++) {
+    optimizeBlend(x, y, count, paint);
+  }
+}
+
+// Rects are mapped this many at a time, into stack storage.
+const int kRectBatch = 64;
+
+// Under an axis-aligned CTM the batch's edges are mapped a column at a time (loops the compiler
+// vectorizes), then each rect is rejected or filled in order just as drawRect would. Any other
+// CTM takes drawRect's polygon path, one rect at a time.
+template<typename PaintAt>
+void MyCanvas::drawRectBatch(const GRect rects[], int count, PaintAt paintAt) {
+  const GMatrix& ctm = currentState().ctm;
+  if(!ctm.isScaleTranslate()) {
+    for(int i = 0; i < count; i++) {
+      drawRect(rects[i], paintAt(i));
     }
-  } else {
-    drawConvexPolygon(rectPoints, 4, paint);
+    return;
   }
+
+  const float sx = ctm[0], sy = ctm[3], tx = ctm[4], ty = ctm[5];
+  float L[kRectBatch], T[kRectBatch], R[kRectBatch], B[kRectBatch];
+  for(int start = 0; start < count; start += kRectBatch) {
+    const GRect* batch = rects + start;
+    int n = min(count - start, kRectBatch);
+    for(int i = 0; i < n; i++) L[i] = sx*batch[i].left + tx;
+    for(int i = 0; i < n; i++) T[i] = sy*batch[i].top + ty;
+    for(int i = 0; i < n; i++) R[i] = sx*batch[i].right + tx;
+    for(int i = 0; i < n; i++) B[i] = sy*batch[i].bottom + ty;
+
+    for(int i = 0; i < n; i++) {
+      GRect bounds = GRect::LTRB(min(L[i], R[i]), min(T[i], B[i]),
+                                 max(L[i], R[i]), max(T[i], B[i]));
+      if(rejectDraw(bounds)) continue;
+      fillDeviceRect({ bounds.left, bounds.top }, { bounds.right, bounds.bottom },
+                     paintAt(start + i));
+    }
+  }
+}
+
+void MyCanvas::drawRects(const GRect rects[], const GPaint paints[], int count) {
+  G_INSTRUMENT_DRAW(GPrimitive::kRect);
+  drawRectBatch(rects, count, [paints](int i) -> const GPaint& { return paints[i]; });
+}
+
+void MyCanvas::drawRects(const GRect rects[], int count, const GPaint& paint) {
+  G_INSTRUMENT_DRAW(GPrimitive::kRect);
+  drawRectBatch(rects, count, [&paint](int) -> const GPaint& { return paint; });
 }
 
 
+// Polygons with up to this many points are mapped into stack storage, larger ones use the heap.
+const int kStackPolygonPoints = 32;
+
+// Walks one side of a convex polygon, from its top vertex down to its bottom vertex, stepping
+// through the points in order (step = 1) or in reverse (step = -1). Like Edge, each segment
+// covers the rows [round(y0), round(y1)) and is sampled at the row's center.
+struct ConvexChain {
+  const GPoint* pts;
+  int count, step, bottomIdx;
+  int curr, next;
+  int rowEnd;
+  float m, b;
+
+  ConvexChain(const GPoint pts[], int count, int topIdx, int bottomIdx, int step)
+    : pts(pts), count(count), step(step), bottomIdx(bottomIdx), curr(topIdx), next(topIdx) {
+    advance();
+  }
+
+  void advance() {
+    curr = next;
+    next = (next + step + count) % count;
+    rowEnd = GRoundToInt(pts[next].y);
+
+    float dy = pts[next].y - pts[curr].y;
+    m = dy != 0 ? (pts[next].x - pts[curr].x) / dy : 0;
+    b = pts[curr].x - m*pts[curr].y;
+  }
+
+  float x(int y) {
+    while(y >= rowEnd && next != bottomIdx) {
+      advance();
+    }
+    return m*(y + 0.5f) + b;
+  }
+};
+
 void MyCanvas::drawConvexPolygon(const GPoint points[], int count, const GPaint& paint) {
-  int boundBottom = canvas.height();
-  int boundRight  = canvas.width();
+  G_INSTRUMENT_DRAW(GPrimitive::kConvexPolygon);
+  if(count < 3) return;
+  if(rejectDraw(mapRect(currentState().ctm, pointBounds(points, count)))) return;
+  fillConvexPolygon(points, count, paint);
+}
 
-  vector<Edge> edges;
-  GMatrix ctm = ctmStack.top();
+void MyCanvas::fillConvexPolygon(const GPoint points[], int count, const GPaint& paint) {
+  const GIRect& clip = currentState().clip;
+  if(count < 3 || clip.isEmpty()) return;
 
-  GPoint transformed[count];
-  ctm.mapPoints(transformed, points, count);
-  
-  for(int i = 0; i < count; i++) {
-    GPoint a = transformed[i];
-    GPoint b = transformed[(i+1)%count];
+  GPoint stackPts[kStackPolygonPoints];
+  unique_ptr<GPoint[]> heapPts;
+  GPoint* pts = stackPts;
+  if(count > kStackPolygonPoints) {
+    heapPts.reset(new GPoint[count]);
+    pts = heapPts.get();
+  }
+  currentState().ctm.mapPoints(pts, points, count);
 
-    clipEdge(edges, a, b, boundBottom, boundRight); 
+  int topIdx = 0, bottomIdx = 0;
+  for(int i = 1; i < count; i++) {
+    if(pts[i].y < pts[topIdx].y) topIdx = i;
+    if(pts[i].y > pts[bottomIdx].y) bottomIdx = i;
   }
 
-  sort(edges.begin(), edges.end());
-  if(edges.size() == 0) return;
+  int top = max(clip.top, GRoundToInt(pts[topIdx].y));
+  int bottom = min(clip.bottom, GRoundToInt(pts[bottomIdx].y));
+  if(top >= bottom) return;
+
+  ConvexChain chain1(pts, count, topIdx, bottomIdx, 1);
+  ConvexChain chain2(pts, count, topIdx, bottomIdx, -1);
 
-  int top = edges.front().top;
-  int bottom = edges.back().bottom;
-  int ptr1 = 0, ptr2 = 1;
   for(int y = top; y < bottom; y++) {
-    if(!edges[ptr1].isValid(y)) {
-      ptr1 = max(ptr1, ptr2) + 1;
-    }
-    if(!edges[ptr2].isValid(y)) {
-      ptr2 = max(ptr1, ptr2) + 1;
+    float x1 = chain1.x(y);
+    float x2 = chain2.x(y);
+
+    int L = max(clip.left, GRoundToInt(min(x1, x2)));
+    int R = min(clip.right, GRoundToInt(max(x1, x2)));
+    if(L < R) {
+      optimizeBlend(L, y, R - L, paint);
     }
+  }
+}
+
+// How far (in device pixels) a path's cached edges may drift from the exact ones when the
+// cache is reused under a slightly different scale/skew.
+const float kFlatCacheSlop = 1.0f/16;
+
+static bool flatCacheMatches(const GPathFlatCache& flat, const GMatrix& ctm) {
+  float dx = abs(ctm[0] - flat.fScaleSkew[0]) + abs(ctm[2] - flat.fScaleSkew[2]);
+  float dy = abs(ctm[1] - flat.fScaleSkew[1]) + abs(ctm[3] - flat.fScaleSkew[3]);
+  return max(dx, dy)*flat.fExtent <= kFlatCacheSlop;
+}
+
+// Max distance (in device pixels) between a curve and the line segments that replace it.
+const float kFlattenTolerance = 0.25f;
+const int kMaxCurveSegments = 4096;
 
-    int edge1x = GRoundToInt(edges[ptr1].x(y+0.5));
-    int edge2x = GRoundToInt(edges[ptr2].x(y+0.5));
+// The chord error of n equal steps is |F''|/(8n^2), and F'' = 2A for a quad.
+static int quadSegments(const GPoint pts[3]) {
+  GPoint A = pts[0] - 2*pts[1] + pts[2];
+  float n = sqrtf(A.length() / (4*kFlattenTolerance));
+  return max(1, (int)min(ceilf(n), (float)kMaxCurveSegments));
+}
 
-    int x = min(edge1x, edge2x);
-    int cnt = max(edge1x, edge2x) - x;
+// For a cubic F'' is linear in t, so its largest length is at an end: 6*max(|D0|, |D1|).
+static int cubicSegments(const GPoint pts[4]) {
+  GPoint D0 = pts[0] - 2*pts[1] + pts[2];
+  GPoint D1 = pts[1] - 2*pts[2] + pts[3];
+  float M = max(D0.length(), D1.length());
+  float n = sqrtf(3*M / (4*kFlattenTolerance));
+  return max(1, (int)min(ceilf(n), (float)kMaxCurveSegments));
+}
 
-    optimizeBlend(x, y, cnt, paint);
+// Walks the curve with forward differences, calling lineTo(a, b) for each segment.
+template<typename Proc>
+static void flattenQuad(const GPoint pts[3], Proc lineTo) {
+  G_INSTRUMENT_CURVES(1);
+  int n = quadSegments(pts);
+  float h = 1.0f/n;
+
+  GPoint A = pts[0] - 2*pts[1] + pts[2];
+  GPoint B = 2*(pts[1] - pts[0]);
+  GPoint d1 = A*h*h + B*h;
+  GPoint d2 = 2*A*h*h;
+
+  GPoint p = pts[0];
+  for(int i = 1; i < n; i++) {
+    GPoint next = p + d1;
+    lineTo(p, next);
+    p = next;
+    d1 += d2;
   }
+  lineTo(p, pts[2]);
 }
 
-void MyCanvas::drawPath(const GPath& path, const GPaint& paint) {
-  int boundBottom = canvas.height();
-  int boundRight  = canvas.width();
-  vector<Edge> edges;
+template<typename Proc>
+static void flattenCubic(const GPoint pts[4], Proc lineTo) {
+  G_INSTRUMENT_CURVES(1);
+  int n = cubicSegments(pts);
+  float h = 1.0f/n;
+
+  GPoint A = pts[3] - pts[0] + 3*(pts[1] - pts[2]);
+  GPoint B = 3*(pts[0] - 2*pts[1] + pts[2]);
+  GPoint C = 3*(pts[1] - pts[0]);
+  GPoint d1 = A*h*h*h + B*h*h + C*h;
+  GPoint d2 = 6*A*h*h*h + 2*B*h*h;
+  GPoint d3 = 6*A*h*h*h;
+
+  GPoint p = pts[0];
+  for(int i = 1; i < n; i++) {
+    GPoint next = p + d1;
+    lineTo(p, next);
+    p = next;
+    d1 += d2;
+    d2 += d3;
+  }
+  lineTo(p, pts[3]);
+}
 
-  GPath cpath = path;
-  cpath.transform(ctmStack.top());
-  GPoint pts[GPath::kMaxNextPoints];
-  GPath::Edger edger(cpath);
+// A curve whose hull lies above or below the device adds no edges. One that lies entirely to the
+// left or right of it only contributes its winding, which its chord carries just as well once
+// clipEdge has projected it onto the device edge.
+static bool hullMissesRows(const GRect& hull, const GIRect& clip) {
+  return hull.bottom <= clip.top || hull.top >= clip.bottom;
+}
 
+static bool hullMissesColumns(const GRect& hull, const GIRect& clip) {
+  return hull.right <= clip.left || hull.left >= clip.right;
+}
+
+static void flattenPath(const GPath& path, const GMatrix& ctm, GPathFlatCache* flat) {
+  GMatrix linear = GMatrix(ctm[0], ctm[2], 0, ctm[1], ctm[3], 0);
+  for(int i = 0; i < 4; i++) flat->fScaleSkew[i] = ctm[i];
+  flat->fPts.clear();
+  flat->fEnds.clear();
+  flat->fRunBounds.clear();
+
+  float extent = 0;
+  auto append = [flat](GPoint a, GPoint b) { flat->fPts.push_back(b); };
+
+  GPoint pts[GPath::kMaxNextPoints];
+  GPath::Edger edger(path);
   while(auto verb = edger.next(pts)) {
+    int n = (int)verb.value() + 1;
+    for(int i = 0; i < n; i++) {
+      extent = max(extent, max(abs(pts[i].x), abs(pts[i].y)));
+    }
+    linear.mapPoints(pts, n);
+
+    int start = (int)flat->fPts.size();
+    flat->fPts.push_back(pts[0]);
     if(verb.value() == GPath::Verb::kLine) {
-        clipEdge(edges, pts[0], pts[1], boundBottom, boundRight);
+      flat->fPts.push_back(pts[1]);
     } else if(verb.value() == GPath::Verb::kQuad) {
-      GPoint E = pts[0]*0.25f - pts[1]*0.5f + pts[2]*0.25f;
-      int num_segs = (int)ceil(sqrtf(4.0f*E.length()));
-      GPoint points[num_segs];
+      flattenQuad(pts, append);
+    } else if(verb.value() == GPath::Verb::kCubic) {
+      flattenCubic(pts, append);
+    }
+    flat->fEnds.push_back((int)flat->fPts.size());
+    flat->fRunBounds.push_back(pointBounds(&flat->fPts[start], (int)flat->fPts.size() - start));
+  }
 
-      float t = 0, tt = 1, step = 1.0f/num_segs;
-      for(int i = 0; i < num_segs; i++) {
-        points[i] = pts[0]*tt*tt + 2*pts[1]*t*tt + pts[2]*t*t;
+  GRect bounds = GRect::LTRB(0, 0, 0, 0);
+  if(!flat->fRunBounds.empty()) {
+    bounds = flat->fRunBounds[0];
+    for(const GRect& r : flat->fRunBounds) {
+      bounds = GRect::LTRB(min(bounds.left, r.left), min(bounds.top, r.top),
+                           max(bounds.right, r.right), max(bounds.bottom, r.bottom));
+    }
+  }
+  flat->fExtent = extent;
+  flat->fBounds = bounds;
+}
 
-        t += step;
-        tt -= step;
-      }
+// Scan converts the path (non-zero winding) under ctm, calling span(x, y, count) for each run of
+// pixels inside it and inside clip. Returns false if the path's bounds miss the clip.
+template<typename Proc>
+bool MyCanvas::scanPath(const GPath& path, const GMatrix& ctm, const GIRect& clip, Proc span) {
+  if(clip.isEmpty()) return false;
+  vector<Edge>& edges = edgeScratch;
+  edges.clear();
+  GRect bound;
+
+  GPathFlatCache* flat = path.isVolatile() ? nullptr : GPathPriv::FlatCache(path);
+  if(flat && flatCacheMatches(*flat, ctm)) {
+    bound = flat->fBounds.offset(ctm[4], ctm[5]);
+  } else {
+    flat = nullptr;
+    bound = mapRect(ctm, path.controlBounds());
+  }
+  if(missesClip(bound, clip)) return false;
 
-      for(int i = 0; i < num_segs-1; i++) {
-        GPoint a = points[i];
-        GPoint b = points[i+1];
-        clipEdge(edges, a, b, boundBottom, boundRight); 
+  // a path is flattened into its cache on its second draw under the same scale/skew, so one
+  // drawn just once doesn't pay for it
+  if(!flat && !path.isVolatile() && GPathPriv::RepeatsScaleSkew(path, ctm)) {
+    flat = GPathPriv::MakeFlatCache(path);
+    flattenPath(path, ctm, flat);
+  }
+
+  if(flat) {
+    GPoint t = { ctm[4], ctm[5] };
+    int start = 0;
+    for(int r = 0; r < flat->fEnds.size(); r++) {
+      int end = flat->fEnds[r];
+      GRect hull = flat->fRunBounds[r].offset(t.x, t.y);
+      if(hullMissesRows(hull, clip)) {
+        // nothing to add
+      } else if(hullMissesColumns(hull, clip)) {
+        clipEdge(edges, flat->fPts[start] + t, flat->fPts[end-1] + t, clip);
+      } else {
+        for(int i = start; i < end-1; i++) {
+          clipEdge(edges, flat->fPts[i] + t, flat->fPts[i+1] + t, clip);
+        }
       }
-      clipEdge(edges, points[num_segs-1], pts[2], boundBottom, boundRight);
-    } else if(verb.value() == GPath::Verb::kCubic) {
-      GPoint E0 = pts[0] - 2*pts[1] + pts[2];
-      GPoint E1 = pts[1] - 2*pts[2] + pts[3];
-      GPoint E = {
-        max(abs(E0.x), abs(E1.x)),
-        max(abs(E0.y), abs(E1.y))
-      };
-      int num_segs = (int)ceil(sqrtf(3.0f*E.length()));
-      GPoint points[num_segs];
-
-      float t = 0, tt = 1, step = 1.0f/num_segs;
-      for(int i = 0; i < num_segs; i++) {
-        points[i] = pts[0]*tt*tt*tt + 3*pts[1]*tt*tt*t + 3*pts[2]*tt*t*t + pts[3]*t*t*t;
-
-        t += step;
-        tt -= step;
+      start = end;
+    }
+  } else {
+    GPoint pts[GPath::kMaxNextPoints];
+    GPath::Edger edger(path);
+    auto addEdge = [&](GPoint a, GPoint b) {
+      clipEdge(edges, a, b, clip);
+    };
+
+    while(auto verb = edger.next(pts)) {
+      int n = (int)verb.value() + 1;
+      ctm.mapPoints(pts, n);
+      if(verb.value() == GPath::Verb::kLine) {
+        addEdge(pts[0], pts[1]);
+        continue;
       }
 
-      for(int i = 0; i < num_segs-1; i++) {
-        GPoint a = points[i];
-        GPoint b = points[i+1];
-        clipEdge(edges, a, b, boundBottom, boundRight); 
+      GRect hull = pointBounds(pts, n);
+      if(hullMissesRows(hull, clip)) {
+        continue;
+      } else if(hullMissesColumns(hull, clip)) {
+        addEdge(pts[0], pts[n-1]);
+      } else if(verb.value() == GPath::Verb::kQuad) {
+        flattenQuad(pts, addEdge);
+      } else if(verb.value() == GPath::Verb::kCubic) {
+        flattenCubic(pts, addEdge);
       }
-      clipEdge(edges, points[num_segs-1], pts[3], boundBottom, boundRight);
     }
-
   }
 
-  if(edges.size() == 0) return;
+  G_INSTRUMENT_EDGES((int)edges.size());
+  if(edges.size() == 0) return true;
   sort(edges.begin(), edges.end());
 
-  GRect bound = cpath.bounds();
-  int top = GRoundToInt(bound.top);
-  int bottom = GRoundToInt(bound.bottom);
+  // edges are clipped, so their rows are already in range
+  int top = edges.front().top;
+  int bottom = top;
+  for(const Edge& e : edges) bottom = max(bottom, e.bottom);
+
+  vector<pair<int, int>>& xx = crossingScratch;
   for(int y = top; y < bottom; y++) {
-    vector<pair<int, int>> xx;
+    xx.clear();
     int i = 0;
     while(i < edges.size()) {
       if(edges[i].isValid(y)) {
@@ -283,12 +686,275 @@ void MyCanvas::drawPath(const GPath& path, const GPaint& paint) {
     for(int ii = 0; ii < xx.size(); ii++) {
       w += xx[ii].second;
       if(w == 0) {
-        optimizeBlend(L, y, xx[ii].first - L, paint);
+        span(L, y, xx[ii].first - L);
         if(ii < xx.size()-1) L = xx[ii+1].first;
       }
     }
 
   }
+  return true;
+}
+
+void MyCanvas::drawPath(const GPath& path, const GPaint& paint) {
+  G_INSTRUMENT_DRAW(GPrimitive::kPath);
+  const CanvasState& state = currentState();
+  drawStats.fDraws++;
+  // starts inside out, so the first span sets it and no spans leave it empty
+  GIRect touched = GIRect::LTRB(state.clip.right, state.clip.bottom,
+                                state.clip.left, state.clip.top);
+  bool drawn = scanPath(path, state.ctm, state.clip, [&](int x, int y, int count) {
+    touched.left = min(touched.left, x);
+    touched.right = max(touched.right, x + count);
+    touched.top = min(touched.top, y);
+    touched.bottom = max(touched.bottom, y + 1);
+    optimizeBlend(x, y, count, paint);
+  });
+  if(!drawn) {
+    drawStats.fRejectedDraws++;
+  }
+  markDirty(touched);
+}
+
+void MyCanvas::clipRect(const GRect& rect) {
+  CanvasState& state = writableState();
+  const GMatrix& ctm = state.ctm;
+  if(!ctm.isScaleTranslate()) {
+    // rotated or skewed, so not a device rect any more
+    GPath path;
+    path.addRect(rect);
+    clipPath(path);
+    return;
+  }
+
+  // a device rect only narrows the clip bounds, which every draw already clips to
+  state.clip = intersect(state.clip, mapRect(ctm, rect).round());
+  if(state.clip.isEmpty()) {
+    state.mask.reset();
+  }
+}
+
+void MyCanvas::clipPath(const GPath& path) {
+  CanvasState& state = writableState();
+  GIRect bounds = intersect(state.clip, roundOut(mapRect(state.ctm, path.controlBounds())));
+  if(bounds.isEmpty()) {
+    state.clip = bounds;
+    state.mask.reset();
+    return;
+  }
+
+  auto mask = make_shared<ClipMask>();
+  mask->bounds = bounds;
+  mask->coverage.assign((size_t)(bounds.right - bounds.left) * (bounds.bottom - bounds.top), 0);
+  scanPath(path, state.ctm, bounds, [&](int x, int y, int count) {
+    uint8_t* row = mask->row(y) - bounds.left;
+    fill(row + x, row + x + count, 255);
+  });
+
+  if(state.mask) {
+    for(int y = bounds.top; y < bounds.bottom; y++) {
+      uint8_t* row = mask->row(y);
+      const uint8_t* prev = state.mask->row(y) + (bounds.left - state.mask->bounds.left);
+      for(int x = 0; x < bounds.right - bounds.left; x++) {
+        row[x] &= prev[x];
+      }
+    }
+  }
+
+  state.clip = bounds;
+  state.mask = mask;
+}
+
+void MyCanvas::saveLayer(const GRect* bounds, const GPaint* paint) {
+  save();
+  CanvasState& state = writableState();
+  GIRect area = state.clip;
+  if(bounds) {
+    area = intersect(area, roundOut(mapRect(state.ctm, *bounds)));
+  }
+  state.isLayer = true;
+  state.clip = area;
+
+  Layer layer;
+  layer.saved = canvas;
+  layer.savedLeft = canvasLeft;
+  layer.savedTop = canvasTop;
+  layer.paint = paint ? *paint : GPaint();
+
+  int width = area.right - area.left;
+  int height = area.bottom - area.top;
+  canvas.reset();
+  if(width > 0 && height > 0) {
+    layer.surface = layerPool.acquire(width, height);
+    canvas = GBitmap(width, height, layer.surface->rowBytes(), layer.surface->pixels(), false);
+    for(int y = 0; y < height; y++) {
+      fill(canvas.getAddr(0, y), canvas.getAddr(0, y) + width, 0);
+    }
+  }
+  canvasLeft = area.left;
+  canvasTop = area.top;
+  layers.push_back(move(layer));
+}
+
+// Called once restore() has popped the layer's state, so the clip (and mask) it composites
+// through are the ones saveLayer was called under.
+void MyCanvas::compositeLayer() {
+  G_INSTRUMENT_DRAW(GPrimitive::kLayer);
+  Layer layer = move(layers.back());
+  layers.pop_back();
+
+  GBitmap src = canvas;
+  int left = canvasLeft, top = canvasTop;
+  canvas = layer.saved;
+  canvasLeft = layer.savedLeft;
+  canvasTop = layer.savedTop;
+  markDirty(GIRect::XYWH(left, top, src.width(), src.height()));
+
+  if(src.width() > 0) {
+    LayerShader shader(src, left, top, layer.paint.getAlpha());
+    GPaint paint(&shader);
+    paint.setBlendMode(layer.paint.getBlendMode());
+    for(int y = top; y < top + src.height(); y++) {
+      optimizeBlend(left, y, src.width(), paint);
+    }
+  }
+}
+
+// Clips the segment to the pixel rect clip (Liang-Barsky). Returns false if none of it is
+// inside.
+static bool clipSegment(GPoint& p0, GPoint& p1, const GIRect& clip) {
+  GVector d = p1 - p0;
+  const float p[4] = { -d.x, d.x, -d.y, d.y };
+  const float q[4] = { p0.x - clip.left, clip.right - p0.x, p0.y - clip.top, clip.bottom - p0.y };
+
+  float t0 = 0, t1 = 1;
+  for(int i = 0; i < 4; i++) {
+    if(p[i] == 0) {
+      if(q[i] < 0) return false;
+      continue;
+    }
+    float t = q[i] / p[i];
+    if(p[i] < 0) {
+      t0 = max(t0, t);
+    } else {
+      t1 = min(t1, t);
+    }
+  }
+  if(t0 > t1) return false;
+
+  GPoint a = p0;
+  p0 = a + d*t0;
+  p1 = a + d*t1;
+  return true;
+}
+
+// Steps a (clipped) hairline one column at a time along its major axis, covering the columns
+// [round(x0), round(x1)) like an edge covers its rows. The minor coordinate (sampled at the
+// column's center) is carried in 16.16 fixed point. With antialias, the coverage at each column
+// is split between the two pixels nearest the line; otherwise it lands on the one it crosses.
+// plot(x, y, coverage) is called with coverage in [1, 255] (255 without antialias).
+template<typename Proc>
+static void walkHairline(GPoint p0, GPoint p1, GIRect clip, bool antialias, Proc plot) {
+  bool steep = abs(p1.y - p0.y) > abs(p1.x - p0.x);
+  if(steep) {
+    swap(p0.x, p0.y);
+    swap(p1.x, p1.y);
+    clip = GIRect::LTRB(clip.top, clip.left, clip.bottom, clip.right);
+  }
+  if(p0.x > p1.x) swap(p0, p1);
+
+  int start = max(clip.left, GRoundToInt(p0.x));
+  int stop = min(clip.right, GRoundToInt(p1.x));
+  if(start >= stop) return;
+
+  float slope = (p1.y - p0.y) / (p1.x - p0.x);
+  float y = p0.y + slope*(start + 0.5f - p0.x);
+  if(antialias) {
+    y -= 0.5f;  // now the top of the two pixels splitting the coverage
+  }
+  int fy = (int)(y * 65536);
+  int dy = (int)(slope * 65536);
+
+  auto put = [&](int major, int minor, int coverage) {
+    if(steep) {
+      plot(minor, major, coverage);
+    } else {
+      plot(major, minor, coverage);
+    }
+  };
+
+  for(int x = start; x < stop; x++, fy += dy) {
+    int iy = fy >> 16;
+    if(!antialias) {
+      put(x, min(max(iy, clip.top), clip.bottom - 1), 255);
+      continue;
+    }
+    int frac = (fy >> 8) & 0xFF;
+    if(frac < 255 && iy >= clip.top && iy < clip.bottom) {
+      put(x, iy, 255 - frac);
+    }
+    if(frac > 0 && iy + 1 >= clip.top && iy + 1 < clip.bottom) {
+      put(x, iy + 1, frac);
+    }
+  }
+}
+
+// Hairlines are mapped into stack storage this many points at a time.
+const int kHairlineBatch = 64;
+
+void MyCanvas::drawHairlines(const GPoint pts[], int count, const GPaint& paint, bool antialias) {
+  G_INSTRUMENT_DRAW(GPrimitive::kHairlines);
+  const GMatrix& ctm = currentState().ctm;
+  const GIRect& clip = currentState().clip;
+  const ClipMask* mask = currentState().mask.get();
+  if(count <= 0) return;
+
+  // a hairline can touch the pixels just past its end points
+  GRect bounds = mapRect(ctm, pointBounds(pts, 2*count));
+  if(rejectDraw(GRect::LTRB(bounds.left - 1, bounds.top - 1, bounds.right + 1, bounds.bottom + 1))) {
+    return;
+  }
+  GPixel src = premul(paint.getColor());
+  GShader* shader = paint.getShader();
+
+  float sa = paint.getAlpha();
+  if(sa == 0 || sa == 1) sa += 1;
+  if(shader) {
+    if(!shader->setContext(ctm)) return;
+    sa = shader->isOpaque() ? 2 : 0;
+  }
+  int proc = chooseProc((int)paint.getBlendMode(), (int)sa);
+  if(proc == 2) return;   // leaves dst alone
+  BlendProc blend = gBlendProcs[proc];
+
+  auto plot = [&](int x, int y, int coverage) {
+    if(mask && !mask->row(y)[x - mask->bounds.left]) return;
+    G_INSTRUMENT_SPAN(paint.getBlendMode(), 1);
+    GPixel s = src;
+    if(shader) {
+      shader->shadeRow(x, y, 1, &s);
+    }
+    GPixel* dst = pixelAddr(x, y);
+    if(coverage == 255) {
+      blend(s, dst);
+    } else {
+      GPixel d = *dst;
+      blend(s, dst);
+      *dst = lerpPixel(d, *dst, coverage);
+    }
+  };
+
+  GPoint mapped[kHairlineBatch];
+  for(int i = 0; i < count; i += kHairlineBatch / 2) {
+    int n = min(count - i, kHairlineBatch / 2);
+    ctm.mapPoints(mapped, pts + 2*i, 2*n);
+    for(int j = 0; j < n; j++) {
+      GPoint p0 = mapped[2*j];
+      GPoint p1 = mapped[2*j + 1];
+      if(clipSegment(p0, p1, clip)) {
+        walkHairline(p0, p1, clip, antialias, plot);
+      }
+    }
+  }
 }
 
 GShader* initColorShader(GPoint U, GPoint V, int n, GPoint points[], const GColor colors[], const int indices[]) {
@@ -332,6 +998,22 @@ GShader* initTexShader(GPoint U, GPoint V, int n, GPoint points[], const GPoint
 
 void MyCanvas::drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[],
     int count, const int indices[], const GPaint& paint) {
+  G_INSTRUMENT_DRAW(GPrimitive::kMesh);
+  if(count <= 0) return;
+  GRect bounds = GRect::LTRB(verts[indices[0]].x, verts[indices[0]].y,
+                             verts[indices[0]].x, verts[indices[0]].y);
+  for(int i = 1; i < 3*count; i++) {
+    GPoint p = verts[indices[i]];
+    bounds = GRect::LTRB(min(bounds.left, p.x), min(bounds.top, p.y),
+                         max(bounds.right, p.x), max(bounds.bottom, p.y));
+  }
+  if(rejectDraw(mapRect(currentState().ctm, bounds))) return;
+  fillMesh(verts, colors, texs, count, indices, paint);
+}
+
+void MyCanvas::fillMesh(const GPoint verts[], const GColor colors[], const GPoint texs[],
+    int count, const int indices[], const GPaint& paint) {
+  const CanvasState& state = currentState();
   GShader* shader;
   int n = 0;
   for(int i = 0; i < count ; i++) {
@@ -340,6 +1022,12 @@ void MyCanvas::drawMesh(const GPoint verts[], const GColor colors[], const GPoin
     points[1] = verts[indices[n+1]];
     points[2] = verts[indices[n+2]];
 
+    // skip triangles outside the clip before building their shaders
+    if(missesClip(mapRect(state.ctm, pointBounds(points, 3)), state.clip)) {
+      n += 3;
+      continue;
+    }
+
     GPoint U = points[1] - points[0];
     GPoint V = points[2] - points[0];
 
@@ -356,7 +1044,7 @@ void MyCanvas::drawMesh(const GPoint verts[], const GColor colors[], const GPoin
     GPaint shaderPaint = paint;
     shaderPaint.setShader(shader);
 
-    drawConvexPolygon(points, 3, shaderPaint);
+    fillConvexPolygon(points, 3, shaderPaint);
     
     n += 3;
   }
@@ -410,6 +1098,9 @@ void drawQuadColor(GColor ncolors[], const GColor colors[4], int level) {
 
 void MyCanvas::drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4],
     int level, const GPaint& paint) {
+  G_INSTRUMENT_DRAW(GPrimitive::kQuad);
+  if(rejectDraw(mapRect(currentState().ctm, pointBounds(verts, 4)))) return;
+
   int num = (2+level)*(2+level);
   int count = 2*(1+level)*(1+level);
   GPoint points[num], ntexs[num];
@@ -463,7 +1154,7 @@ void MyCanvas::drawQuad(const GPoint verts[4], const GColor colors[4], const GPo
     }
   }
 
-  drawMesh(points, colors?ncolors:nullptr, texs?ntexs:nullptr, count, indices, paint);
+  fillMesh(points, colors?ncolors:nullptr, texs?ntexs:nullptr, count, indices, paint);
 }
 
 
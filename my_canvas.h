@@ -15,29 +15,73 @@
 #include "include/GMath.h"
 
 #include "blender.h"
+#include "edge.h"
 #include "bitmap_shader.h"
 #include "gradient_shader.h"
 #include "tricolor_shader.h"
 #include "tex_shader.h"
 #include "texcolor_shader.h"
+#include "layer_shader.h"
+#include "layer_pool.h"
 
+#include <memory>
 #include <vector>
-#include <stack>
 #include <iostream>
 
+// Coverage for a clip that isn't a rectangle: one byte per pixel of bounds, 0 or 255.
+struct ClipMask {
+  GIRect bounds;
+  std::vector<uint8_t> coverage;
+
+  uint8_t* row(int y) {
+    return coverage.data() + (y - bounds.top) * (bounds.right - bounds.left);
+  }
+  const uint8_t* row(int y) const {
+    return coverage.data() + (y - bounds.top) * (bounds.right - bounds.left);
+  }
+};
+
+// What save() records and restore() brings back.
+struct CanvasState {
+  GMatrix ctm;
+  GIRect clip;                            // device pixels that may be drawn (may be empty)
+  std::shared_ptr<const ClipMask> mask;   // null when the clip is exactly clip
+  bool isLayer = false;                   // pushed by saveLayer, so restore composites
+  int deferredSaves = 0;                  // save()s of this state not yet copied (see save())
+};
+
+// An offscreen layer from saveLayer, and what drawing goes back to when it is restored.
+struct Layer {
+  GBitmap saved;
+  int savedLeft, savedTop;
+  GOwnedBitmap surface;
+  GPaint paint;
+};
+
 class MyCanvas : public GCanvas {
 public:
     MyCanvas(const GBitmap& device) : canvas(device) {
-      ctmStack.push(GMatrix(1,0,0,0,1,0));
+      stateStack.push_back({ GMatrix(1,0,0,0,1,0), GIRect::WH(device.width(), device.height()), nullptr });
     }
 
     void save() override;
+    void saveLayer(const GRect* bounds, const GPaint* paint) override;
     void restore() override;
     void concat(const GMatrix& matrix) override;
+    void clipRect(const GRect& rect) override;
+    void clipPath(const GPath& path) override;
+    bool quickReject(const GRect& rect) const override;
+    GCanvasStats stats() const override { return drawStats; }
+    void resetStats() override { drawStats = GCanvasStats(); }
+    GIRect dirtyBounds() const override { return dirty; }
+    void resetDirty() override { dirty = GIRect::LTRB(0, 0, 0, 0); }
     void clear(const GColor& color) override;
     void drawRect(const GRect& rect, const GPaint& paint) override;
+    void drawRects(const GRect rects[], const GPaint paints[], int count) override;
+    void drawRects(const GRect rects[], int count, const GPaint& paint) override;
     void drawConvexPolygon(const GPoint points[], int count, const GPaint& paint) override;
     void drawPath(const GPath&, const GPaint&) override;
+    void drawHairlines(const GPoint pts[], int count, const GPaint& paint, bool antialias) override;
     void drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[],
         int count, const int indices[], const GPaint& paint) override;
     void drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4],
@@ -50,8 +94,44 @@ public:
 
 
 private:
-    const GBitmap canvas;
-    std::stack<GMatrix> ctmStack;
+    // where drawing lands: the device, or the innermost layer, whose top-left is at
+    // (canvasLeft, canvasTop) in device space. Its isOpaque() is kept up to date as it is drawn
+    // into, so blending can take the shortcuts an opaque dst allows.
+    GBitmap canvas;
+    int canvasLeft = 0, canvasTop = 0;
+
+    // The save stack, flat: a save() that is restored before anything changes is only a count
+    // on the top entry.
+    std::vector<CanvasState> stateStack;
+    LayerPool layerPool;  // declared before layers, which hand their surfaces back to it
+    std::vector<Layer> layers;
+    GCanvasStats drawStats;
+    GIRect dirty = GIRect::LTRB(0, 0, 0, 0);  // device pixels touched since resetDirty()
+
+    // scratch storage reused by drawPath, so steady-state redraws don't allocate
+    std::vector<Edge> edgeScratch;
+    std::vector<std::pair<int, int>> crossingScratch;
+
+    const CanvasState& currentState() const { return stateStack.back(); }
+    CanvasState& writableState();
+
+    GPixel* pixelAddr(int x, int y) const {
+      return canvas.getAddr(x - canvasLeft, y - canvasTop);
+    }
+    void blendRow(int x, int y, int count, const GPaint& paint);
+    int chooseProc(int blendMode, int sa);
+    void compositeLayer();
+    bool rejectDraw(const GRect& deviceBounds);
+    void markDirty(const GIRect& area);
+    void fillConvexPolygon(const GPoint points[], int count, const GPaint& paint);
+    void fillDeviceRect(GPoint lt, GPoint rb, const GPaint& paint);
+    template<typename PaintAt>
+      void drawRectBatch(const GRect rects[], int count, PaintAt paintAt);
+    void fillMesh(const GPoint verts[], const GColor colors[], const GPoint texs[],
+        int count, const int indices[], const GPaint& paint);
+
+    template<typename Proc>
+      bool scanPath(const GPath& path, const GMatrix& ctm, const GIRect& clip, Proc span);
 };
 
 #endif
@@ -177,6 +177,21 @@ GRect GPath::bounds() const {
   return GRect::LTRB(left, top, right, bottom);
 }
 
+GRect GPath::controlBounds() const {
+  if(countPoints() == 0) {
+    return GRect::LTRB(0, 0, 0, 0);
+  }
+
+  float left = fPts[0].x, right = fPts[0].x, top = fPts[0].y, bottom = fPts[0].y;
+  for(GPoint p : fPts) {
+    left = min(left, p.x);
+    top = min(top, p.y);
+    right = max(right, p.x);
+    bottom = max(bottom, p.y);
+  }
+  return GRect::LTRB(left, top, right, bottom);
+}
+
 void GPath::ChopQuadAt(const GPoint src[3], GPoint dst[5], float t) {
   GPoint a = src[0];
   GPoint b = src[1];
@@ -218,6 +233,7 @@ void GPath::ChopCubicAt(const GPoint src[4], GPoint dst[7], float t) {
 }
 
 void GPath::transform(const GMatrix& matrix) {
+  this->invalidate();
   for(int i = 0; i < fPts.size(); i++) {
     fPts[i] = matrix*fPts[i];
   }
@@ -4,6 +4,10 @@
 
 #include "../include/GBitmap.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 void GBitmap::setIsOpaque(IsOpaque io) {
     switch (io) {
         case kYes_IsOpaque: fIsOpaque = true;  break;
@@ -21,23 +25,52 @@ void GBitmap::reset(int w, int h, size_t rb, GPixel* pixels, IsOpaque io) {
     this->validate();
 }
 
+// ANDs every pixel of the row together: the row is opaque if the result's alpha is 0xFF.
+static GPixel and_row(const GPixel row[], int count) {
+    GPixel acc = ~0u;
+    int x = 0;
+#ifdef __SSE2__
+    __m128i acc4 = _mm_set1_epi32(-1);
+    for (; x + 8 <= count; x += 8) {
+        acc4 = _mm_and_si128(acc4, _mm_loadu_si128((const __m128i*)(row + x)));
+        acc4 = _mm_and_si128(acc4, _mm_loadu_si128((const __m128i*)(row + x + 4)));
+    }
+    acc4 = _mm_and_si128(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc4 = _mm_and_si128(acc4, _mm_shuffle_epi32(acc4, _MM_SHUFFLE(2, 3, 0, 1)));
+    acc = (GPixel)_mm_cvtsi128_si32(acc4);
+#endif
+    for (; x < count; ++x) {
+        acc &= row[x];
+    }
+    return acc;
+}
+
 bool GBitmap::ComputeIsOpaque(const GBitmap& bm) {
     for (int y = 0; y < bm.height(); ++y) {
-        const GPixel* row = bm.getAddr(0, y);
-        for (int x = 0; x < bm.width(); ++x) {
-            if (GPixel_GetA(row[x]) != 0xFF) {
-                return false;
-            }
+        if (GPixel_GetA(and_row(bm.getAddr(0, y), bm.width())) != 0xFF) {
+            return false;
         }
     }
     return true;
 }
 
+size_t GBitmap::PreferredRowBytes(int w) {
+    assert(w >= 0);
+    const size_t kCacheLine = 64;
+    const size_t kAliasStride = 1024;
+
+    size_t rb = (w * sizeof(GPixel) + kCacheLine - 1) & ~(kCacheLine - 1);
+    if (rb > 0 && rb % kAliasStride == 0) {
+        rb += kCacheLine;
+    }
+    return rb;
+}
+
 void GBitmap::alloc(int w, int h, size_t rb) {
     assert(w >= 0);
     assert(h >= 0);
     if (rb == 0) {
-        rb = w * sizeof(GPixel);
+        rb = PreferredRowBytes(w);
     }
     fWidth = w;
     fHeight = h;
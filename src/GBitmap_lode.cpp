@@ -3,30 +3,20 @@
  */
 
 #include "../include/GBitmap.h"
+#include "GPNGWriter.h"
 #include "lodepng.h"
+#include <vector>
 
-static void convertToPNG(const GPixel src[], int width, uint8_t dst[]) {
-    for (int i = 0; i < width; i++) {
-        GPixel c = *src++;
-        int a = GPixel_GetA(c);
-        int r = GPixel_GetR(c);
-        int g = GPixel_GetG(c);
-        int b = GPixel_GetB(c);
-        
-        // PNG requires unpremultiplied, but GPixel is premultiplied
-        if (0 != a && 255 != a) {
-            r = (r * 255 + a/2) / a;
-            g = (g * 255 + a/2) / a;
-            b = (b * 255 + a/2) / a;
+bool GBitmap::writeToFile(const char path[], const GPNGOptions& options) const {
+    if (options.fCompression <= GPNGOptions::kFast) {
+        FILE* file = fopen(path, "wb");
+        if (!file) {
+            return false;
         }
-        *dst++ = r;
-        *dst++ = g;
-        *dst++ = b;
-        *dst++ = a;
+        bool ok = GPNGWriteStreamed(file, *this, options);
+        return (fclose(file) == 0) && ok;
     }
-}
 
-bool GBitmap::writeToFile(const char path[]) const {
     size_t rb = this->width() * 4;
     uint8_t* pix = (uint8_t*)malloc(this->height() * rb);
     if (!pix) {
@@ -36,55 +26,153 @@ bool GBitmap::writeToFile(const char path[]) const {
     const GPixel* src = this->pixels();
     uint8_t* dst = pix;
     for (int y = 0; y < this->height(); ++y) {
-        convertToPNG(src, this->width(), dst);
+        GPNGUnpremulRow(src, this->width(), dst);
         src += this->rowBytes() / 4;
         dst += rb;
     }
 
-    unsigned err = lodepng_encode32_file(path, pix, this->width(), this->height());
+    LodePNGState state;
+    lodepng_state_init(&state);
+    if (options.fCompression == GPNGOptions::kBest) {
+        state.encoder.zlibsettings.windowsize = 32768;
+        state.encoder.zlibsettings.nicematch = 258;
+    }
+    std::vector<uint8_t> filters;
+    switch (options.fFilter) {
+        case GPNGOptions::kNone_Filter:     state.encoder.filter_strategy = LFS_ZERO; break;
+        case GPNGOptions::kAdaptive_Filter: state.encoder.filter_strategy = LFS_MINSUM; break;
+        default: {
+            static const uint8_t kTypes[] = { 0, 1, 2, 4 };
+            filters.assign(this->height(), kTypes[options.fFilter]);
+            state.encoder.filter_strategy = LFS_PREDEFINED;
+            state.encoder.filter_palette_zero = 0;
+            state.encoder.predefined_filters = filters.data();
+        } break;
+    }
+
+    uint8_t* png = nullptr;
+    size_t pngSize = 0;
+    unsigned err = lodepng_encode(&png, &pngSize, pix, this->width(), this->height(), &state);
+    if (!err) {
+        err = lodepng_save_file(png, pngSize, path);
+    }
+    free(png);
+    lodepng_state_cleanup(&state);
     free(pix);
     return err == 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static int alpha_mul(unsigned a, unsigned c) {
-    return (a * c + 127) / 255;
+// (a * c + 127) / 255 == (c * fScale[a] + (1 << 23)) >> 24 for every a and c in [0, 255].
+struct PremulTable {
+    uint32_t fScale[256];
+
+    PremulTable() {
+        for (int a = 0; a < 256; ++a) {
+            fScale[a] = (uint32_t)(((uint64_t)a << 24) + 127) / 255;
+        }
+    }
+};
+
+static const PremulTable gPremul;
+
+static unsigned premul(unsigned c, uint32_t scale) {
+    return (c * scale + (1 << 23)) >> 24;
 }
 
-static void swizzle_rgba_row(GPixel dst[], const uint8_t src[], int count) {
+// Returns true if every pixel in the row was opaque.
+static bool swizzle_rgba_row(GPixel dst[], const uint8_t src[], int count) {
+    unsigned allA = 0xFF;
     for (int i = 0; i < count; ++i) {
         unsigned a = src[3];
-        dst[i] = GPixel_PackARGB(a,
-                                 alpha_mul(a, src[0]),
-                                 alpha_mul(a, src[1]),
-                                 alpha_mul(a, src[2]));
+        allA &= a;
+        if (a == 0xFF) {
+            dst[i] = GPixel_PackARGB(a, src[0], src[1], src[2]);
+        } else {
+            uint32_t scale = gPremul.fScale[a];
+            dst[i] = GPixel_PackARGB(a,
+                                     premul(src[0], scale),
+                                     premul(src[1], scale),
+                                     premul(src[2], scale));
+        }
         src += 4;
     }
+    return allA == 0xFF;
+}
+
+// An RGB PNG can still have a tRNS chunk naming one color as transparent. Returns true if no
+// pixel in the row had that color.
+static bool swizzle_rgb_row(GPixel dst[], const uint8_t src[], int count,
+                            const LodePNGColorMode& color) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = GPixel_PackARGB(0xFF, src[0], src[1], src[2]);
+        src += 3;
+    }
+    if (!color.key_defined) {
+        return true;
+    }
+
+    bool opaque = true;
+    const GPixel key = GPixel_PackARGB(0xFF, color.key_r, color.key_g, color.key_b);
+    for (int i = 0; i < count; ++i) {
+        if (dst[i] == key) {
+            dst[i] = 0;
+            opaque = false;
+        }
+    }
+    return opaque;
 }
 
 bool GBitmap::readFromFile(const char path[]) {
+    this->reset();
+
+    unsigned char* file = nullptr;
+    size_t fileSize = 0;
+    if (lodepng_load_file(&file, &fileSize, path)) {
+        free(file);
+        return false;
+    }
+
+    // Ask lodepng for the PNG's own layout when it is 8-bit RGB or RGBA, so it hands back its
+    // unfiltered rows as they are instead of converting them into another buffer first.
+    LodePNGState state;
+    lodepng_state_init(&state);
     unsigned w, h;
+    bool rgb = false;
+    if (!lodepng_inspect(&w, &h, &state, file, fileSize)) {
+        const LodePNGColorMode& color = state.info_png.color;
+        rgb = color.colortype == LCT_RGB && color.bitdepth == 8;
+    }
+    state.info_raw.colortype = rgb ? LCT_RGB : LCT_RGBA;
+    state.info_raw.bitdepth = 8;
+
     unsigned char* pix = nullptr;
-    if (lodepng_decode32_file(&pix, &w, &h, path)) {
+    unsigned err = lodepng_decode(&pix, &w, &h, &state, file, fileSize);
+    free(file);
+    if (err) {
+        lodepng_state_cleanup(&state);
         free(pix);
         return false;
     }
 
     this->alloc(w, h);
 
-    GPixel* dst = this->pixels();
+    // premultiply and check for opacity in the same pass, instead of rescanning afterwards
+    bool opaque = true;
     const uint8_t* src = pix;
-    size_t rb = w * 4;
+    size_t srcRB = w * (rgb ? 3 : 4);
     for (unsigned y = 0; y < h; ++y) {
-        swizzle_rgba_row(dst, src, w);
-        src += rb;
-        dst += this->rowBytes() / 4;
+        if (rgb) {
+            opaque &= swizzle_rgb_row(this->getAddr(0, y), src, w, state.info_png.color);
+        } else {
+            opaque &= swizzle_rgba_row(this->getAddr(0, y), src, w);
+        }
+        src += srcRB;
     }
+    lodepng_state_cleanup(&state);
     free(pix);
 
-    this->setIsOpaque(kCompute_IsOpaque);
+    this->setIsOpaque(opaque ? kYes_IsOpaque : kNo_IsOpaque);
     return true;
 }
-
-
@@ -0,0 +1,130 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#include "../include/GInstrument.h"
+
+#include <chrono>
+#include <vector>
+
+// One top-level draw call, for the trace.
+struct DrawEvent {
+    GPrimitive  fPrimitive;
+    int64_t     fStart;     // nanos since the frame began
+    int64_t     fNanos;
+};
+
+struct Frame {
+    GFrameCounters          fCounters;
+    std::vector<DrawEvent>  fEvents;
+    int64_t                 fBegin = 0;
+    int64_t                 fDrawStart = 0;
+    GPrimitive              fPrimitive = GPrimitive::kClear;
+    int                     fDepth = 0;     // draw calls in progress
+};
+
+static thread_local Frame gFrame;
+
+static int64_t now_nanos() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* const kPrimitiveNames[] = {
+    "clear", "rect", "convex_polygon", "path", "hairlines", "mesh", "quad", "layer",
+};
+static_assert(sizeof(kPrimitiveNames) / sizeof(kPrimitiveNames[0]) == kGPrimitiveCount, "");
+
+static const char* const kBlendModeNames[] = {
+    "clear", "src", "dst", "src_over", "dst_over", "src_in", "dst_in", "src_out", "dst_out",
+    "src_atop", "dst_atop", "xor",
+};
+static_assert(sizeof(kBlendModeNames) / sizeof(kBlendModeNames[0]) == kGBlendModeCount, "");
+
+///////////////////////////////////////////////////////////////////////////////
+
+void GInstrument::BeginFrame() {
+    gFrame.fCounters = GFrameCounters();
+    gFrame.fEvents.clear();
+    gFrame.fBegin = now_nanos();
+}
+
+const GFrameCounters& GInstrument::Counters() {
+    return gFrame.fCounters;
+}
+
+void GInstrument::BeginDraw(GPrimitive primitive) {
+    if (gFrame.fDepth++ == 0) {
+        gFrame.fPrimitive = primitive;
+        gFrame.fCounters.fPrimitives[(int)primitive].fCalls += 1;
+        gFrame.fDrawStart = now_nanos();
+    }
+}
+
+void GInstrument::EndDraw() {
+    if (--gFrame.fDepth == 0) {
+        int64_t nanos = now_nanos() - gFrame.fDrawStart;
+        gFrame.fCounters.fPrimitives[(int)gFrame.fPrimitive].fNanos += nanos;
+        gFrame.fEvents.push_back({ gFrame.fPrimitive, gFrame.fDrawStart - gFrame.fBegin, nanos });
+    }
+}
+
+void GInstrument::CountSpan(GBlendMode mode, int pixels) {
+    gFrame.fCounters.fBlendedPixels[(int)mode] += pixels;
+    if (gFrame.fDepth > 0) {
+        GFrameCounters::Primitive& prim = gFrame.fCounters.fPrimitives[(int)gFrame.fPrimitive];
+        prim.fSpans += 1;
+        prim.fPixels += pixels;
+    }
+}
+
+void GInstrument::CountEdges(int count) {
+    gFrame.fCounters.fEdges += count;
+}
+
+void GInstrument::CountCurves(int count) {
+    gFrame.fCounters.fCurves += count;
+}
+
+bool GInstrument::WriteJSON(FILE* file) {
+    const GFrameCounters& counters = gFrame.fCounters;
+    fprintf(file, "{\n  \"primitives\": {");
+    const char* sep = "";
+    for (int i = 0; i < kGPrimitiveCount; ++i) {
+        const GFrameCounters::Primitive& prim = counters.fPrimitives[i];
+        if (prim.fCalls == 0) {
+            continue;
+        }
+        fprintf(file, "%s\n    \"%s\": { \"calls\": %lld, \"spans\": %lld, \"pixels\": %lld, "
+                      "\"ms\": %.3f }", sep, kPrimitiveNames[i], (long long)prim.fCalls,
+                (long long)prim.fSpans, (long long)prim.fPixels, prim.fNanos * 1e-6);
+        sep = ",";
+    }
+    fprintf(file, "%s},\n  \"blended_pixels\": {", *sep ? "\n  " : "");
+    sep = "";
+    for (int i = 0; i < kGBlendModeCount; ++i) {
+        if (counters.fBlendedPixels[i] == 0) {
+            continue;
+        }
+        fprintf(file, "%s \"%s\": %lld", sep, kBlendModeNames[i],
+                (long long)counters.fBlendedPixels[i]);
+        sep = ",";
+    }
+    fprintf(file, "%s},\n  \"edges\": %lld,\n  \"curves\": %lld\n}\n", *sep ? " " : "",
+            (long long)counters.fEdges, (long long)counters.fCurves);
+    return !ferror(file);
+}
+
+bool GInstrument::WriteTrace(FILE* file) {
+    fprintf(file, "{\"traceEvents\":[");
+    const char* sep = "";
+    for (const DrawEvent& e : gFrame.fEvents) {
+        // trace_event times are in microseconds
+        fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"draw\",\"ph\":\"X\",\"ts\":%.3f,"
+                      "\"dur\":%.3f,\"pid\":1,\"tid\":1}", sep, kPrimitiveNames[(int)e.fPrimitive],
+                e.fStart * 1e-3, e.fNanos * 1e-3);
+        sep = ",";
+    }
+    fprintf(file, "\n]}\n");
+    return !ferror(file);
+}
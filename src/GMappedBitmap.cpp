@@ -0,0 +1,128 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#include "../include/GMappedBitmap.h"
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The first 64 bytes of a raw image; the rows follow.
+struct RawHeader {
+    char        fMagic[8];
+    uint32_t    fWidth;
+    uint32_t    fHeight;
+    uint32_t    fRowBytes;
+    uint32_t    fFlags;
+    GPixel      fSample;    // kSample, as this build packs it
+    uint8_t     fReserved[36];
+};
+static_assert(sizeof(RawHeader) == 64, "rows must start on a cache line");
+
+static const char kMagic[8] = { 'G', 'R', 'A', 'W', 'B', 'M', 'P', '1' };
+static const uint32_t kOpaque_Flag = 1 << 0;
+static const GPixel kSample = GPixel_PackARGB(0xFF, 0x11, 0x22, 0x33);
+
+///////////////////////////////////////////////////////////////////////////////
+
+GMappedBitmap::GMappedBitmap(GMappedBitmap&& src)
+    : fBitmap(src.fBitmap), fBase(src.fBase), fLength(src.fLength) {
+    src.fBitmap.reset();
+    src.fBase = nullptr;
+    src.fLength = 0;
+}
+
+GMappedBitmap& GMappedBitmap::operator=(GMappedBitmap&& src) {
+    if (this != &src) {
+        this->reset();
+        fBitmap = src.fBitmap;
+        fBase = src.fBase;
+        fLength = src.fLength;
+        src.fBitmap.reset();
+        src.fBase = nullptr;
+        src.fLength = 0;
+    }
+    return *this;
+}
+
+void GMappedBitmap::reset() {
+    if (fBase) {
+        munmap(fBase, fLength);
+    }
+    fBitmap.reset();
+    fBase = nullptr;
+    fLength = 0;
+}
+
+GMappedBitmap GMappedBitmap::Map(const char path[]) {
+    GMappedBitmap mapped;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return mapped;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(RawHeader)) {
+        close(fd);
+        return mapped;
+    }
+    size_t length = info.st_size;
+    void* base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping keeps the file
+    if (base == MAP_FAILED) {
+        return mapped;
+    }
+
+    const RawHeader* header = (const RawHeader*)base;
+    uint64_t w = header->fWidth, h = header->fHeight, rb = header->fRowBytes;
+    bool valid = memcmp(header->fMagic, kMagic, 8) == 0 && header->fSample == kSample &&
+                 w > 0 && w <= (1u << 30) && h > 0 && h <= INT_MAX &&
+                 rb % 4 == 0 && w <= rb / 4 &&
+                 sizeof(RawHeader) + h * rb <= length;
+    if (!valid) {
+        munmap(base, length);
+        return mapped;
+    }
+
+    // GBitmap takes non-const pixels, but the pages are read-only: writes fault
+    GPixel* pixels = (GPixel*)((char*)base + sizeof(RawHeader));
+    bool opaque = header->fFlags & kOpaque_Flag;
+    mapped.fBitmap.reset((int)w, (int)h, rb, pixels,
+                         opaque ? GBitmap::kYes_IsOpaque : GBitmap::kNo_IsOpaque);
+    mapped.fBase = base;
+    mapped.fLength = length;
+    return mapped;
+}
+
+bool GMappedBitmap::Write(const GBitmap& bitmap, const char path[]) {
+    RawHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.fMagic, kMagic, 8);
+    header.fWidth = bitmap.width();
+    header.fHeight = bitmap.height();
+    header.fRowBytes = (uint32_t)GBitmap::PreferredRowBytes(bitmap.width());
+    header.fFlags = bitmap.isOpaque() ? kOpaque_Flag : 0;
+    header.fSample = kSample;
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    // rows are repacked to the preferred stride, whatever the source's is
+    const size_t used = bitmap.width() * sizeof(GPixel);
+    const size_t padding = header.fRowBytes - used;
+    static const char kZeros[128] = {};
+    for (int y = 0; ok && y < bitmap.height(); ++y) {
+        const char* row = (const char*)bitmap.pixels() + y * bitmap.rowBytes();
+        ok = fwrite(row, 1, used, file) == used &&
+             fwrite(kZeros, 1, padding, file) == padding;
+    }
+    return (fclose(file) == 0) && ok;
+}
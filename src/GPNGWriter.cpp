@@ -0,0 +1,637 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#include "GPNGWriter.h"
+#include "lodepng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// (c * 255 + a/2) / a == ((c * 255 + a/2) * gUnpremul.fScale[a]) >> 32 for every c and a in
+// [0, 255]: with the scale rounded up, the error never reaches the next integer.
+struct UnpremulTable {
+    uint64_t fScale[256];
+
+    UnpremulTable() {
+        fScale[0] = 0;
+        for (int a = 1; a < 256; ++a) {
+            fScale[a] = ((1ull << 32) + a - 1) / a;
+        }
+    }
+};
+
+static const UnpremulTable gUnpremul;
+
+void GPNGUnpremulRow(const GPixel src[], int width, uint8_t dst[]) {
+    for (int i = 0; i < width; ++i) {
+        GPixel c = src[i];
+        unsigned a = GPixel_GetA(c);
+        unsigned r = GPixel_GetR(c);
+        unsigned g = GPixel_GetG(c);
+        unsigned b = GPixel_GetB(c);
+
+        if (0 != a && 255 != a) {
+            uint64_t scale = gUnpremul.fScale[a];
+            r = (uint32_t)(((r * 255 + a/2) * scale) >> 32);
+            g = (uint32_t)(((g * 255 + a/2) * scale) >> 32);
+            b = (uint32_t)(((b * 255 + a/2) * scale) >> 32);
+        }
+        dst[0] = r;
+        dst[1] = g;
+        dst[2] = b;
+        dst[3] = a;
+        dst += 4;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PNG row filters (bpp is always 4)
+
+static int abs_residual(uint8_t v) {
+    return v < 128 ? v : 256 - v;
+}
+
+static uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// Writes the filter type byte, then the filtered row. Returns the sum of the residuals' sizes,
+// which the adaptive filter uses to pick a row's filter.
+static int filter_row(int type, const uint8_t cur[], const uint8_t prev[], int n, uint8_t out[]) {
+    *out++ = type;
+    switch (type) {
+        case 0:
+            memcpy(out, cur, n);
+            break;
+        case 1:
+            for (int i = 0; i < n; ++i) {
+                out[i] = cur[i] - (i >= 4 ? cur[i - 4] : 0);
+            }
+            break;
+        case 2:
+            for (int i = 0; i < n; ++i) {
+                out[i] = cur[i] - prev[i];
+            }
+            break;
+        case 3:
+            for (int i = 0; i < n; ++i) {
+                out[i] = cur[i] - (((i >= 4 ? cur[i - 4] : 0) + prev[i]) >> 1);
+            }
+            break;
+        case 4:
+            for (int i = 0; i < n; ++i) {
+                out[i] = cur[i] - (i >= 4 ? paeth(cur[i - 4], prev[i], prev[i - 4])
+                                          : prev[i]);
+            }
+            break;
+    }
+
+    int sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += abs_residual(out[i]);
+    }
+    return sum;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Deflate with fixed Huffman codes (RFC 1951, 3.2.6)
+
+static const int kLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const int kLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const int kDistBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const int kDistExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+static const int kMinMatch = 3;
+static const int kMaxMatch = 258;
+static const int kWindow = 32768;
+
+static uint32_t reverse_bits(uint32_t code, int length) {
+    uint32_t r = 0;
+    for (int i = 0; i < length; ++i) {
+        r = (r << 1) | ((code >> i) & 1);
+    }
+    return r;
+}
+
+// Codes are stored bit-reversed, ready to be written LSB first.
+struct FixedCodes {
+    uint16_t fLitCode[288];
+    uint8_t  fLitLength[288];
+    uint8_t  fLengthSymbol[kMaxMatch + 1];  // match length -> index into kLengthBase
+    uint8_t  fDistSymbol[kWindow + 1];      // distance -> index into kDistBase
+
+    FixedCodes() {
+        for (int v = 0; v < 288; ++v) {
+            int length, code;
+            if (v < 144)      { length = 8; code = 0x30 + v; }
+            else if (v < 256) { length = 9; code = 0x190 + (v - 144); }
+            else if (v < 280) { length = 7; code = v - 256; }
+            else              { length = 8; code = 0xC0 + (v - 280); }
+            fLitCode[v] = reverse_bits(code, length);
+            fLitLength[v] = length;
+        }
+        for (int s = 0; s < 29; ++s) {
+            int end = s < 28 ? kLengthBase[s + 1] : kMaxMatch + 1;
+            for (int len = kLengthBase[s]; len < end; ++len) {
+                fLengthSymbol[len] = s;
+            }
+        }
+        fLengthSymbol[kMaxMatch] = 28;
+        for (int s = 0; s < 30; ++s) {
+            int end = s < 29 ? kDistBase[s + 1] : kWindow + 1;
+            for (int d = kDistBase[s]; d < end; ++d) {
+                fDistSymbol[d] = s;
+            }
+        }
+    }
+};
+
+static const FixedCodes& fixed_codes() {
+    static const FixedCodes gCodes;
+    return gCodes;
+}
+
+static uint32_t update_adler(uint32_t adler, const uint8_t data[], size_t n) {
+    const uint32_t kMod = 65521;
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (n > 0) {
+        size_t run = std::min(n, (size_t)5552);     // the most before the sums can overflow
+        for (size_t i = 0; i < run; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= kMod;
+        b %= kMod;
+        data += run;
+        n -= run;
+    }
+    return (b << 16) | a;
+}
+
+// The Adler-32 of A followed by B, from theirs and B's length (as zlib's adler32_combine).
+static uint32_t combine_adler(uint32_t adlerA, uint32_t adlerB, size_t lengthB) {
+    const uint32_t kMod = 65521;
+    uint32_t rem = (uint32_t)(lengthB % kMod);
+    uint32_t a = adlerA & 0xFFFF;
+    uint32_t b = (uint32_t)(((uint64_t)rem * a) % kMod);
+    a += (adlerB & 0xFFFF) + kMod - 1;
+    b += (adlerA >> 16) + (adlerB >> 16) + kMod - rem;
+    if (a >= kMod) a -= kMod;
+    if (a >= kMod) a -= kMod;
+    if (b >= (kMod << 1)) b -= (kMod << 1);
+    if (b >= kMod) b -= kMod;
+    return (b << 16) | a;
+}
+
+// Compresses bytes into raw deflate data appended to *out. The final deflater's last block is
+// marked BFINAL; any other ends byte-aligned with an empty stored block (a zlib "sync flush"),
+// so the next one's output can simply be appended.
+class Deflater {
+public:
+    Deflater(GPNGOptions::Compression mode, bool final, std::vector<uint8_t>* out)
+        : fMode(mode), fFinal(final), fCodes(fixed_codes()), fOut(out) {
+        if (fMode != GPNGOptions::kStore) {
+            this->putBits(final ? 1 : 0, 1);    // BFINAL: everything goes in one block
+            this->putBits(1, 2);                // BTYPE 01: fixed Huffman codes
+            if (fMode == GPNGOptions::kFast) {
+                fHead.assign(1 << kHashBits, -1);
+            }
+        }
+    }
+
+    // Bytes the data that follows may match against, but which aren't themselves encoded: the
+    // tail of whatever came before this deflater's part of the stream.
+    void prime(const uint8_t data[], size_t n) {
+        if (fMode == GPNGOptions::kStore) {
+            return;
+        }
+        size_t start = fWindow.size();
+        fWindow.insert(fWindow.end(), data, data + n);
+        if (fMode == GPNGOptions::kFast) {
+            for (size_t i = start; i + kMinMatch <= fWindow.size(); ++i) {
+                fHead[hash3(&fWindow[i])] = (int32_t)i;
+            }
+        }
+        fPos = fWindow.size();
+    }
+
+    void add(const uint8_t data[], size_t n) {
+        if (fMode == GPNGOptions::kStore) {
+            while (n > 0) {
+                size_t take = std::min(n, kMaxStored - fStored.size());
+                fStored.insert(fStored.end(), data, data + take);
+                data += take;
+                n -= take;
+                if (fStored.size() == kMaxStored) {
+                    this->emitStored(false);
+                }
+            }
+        } else {
+            fWindow.insert(fWindow.end(), data, data + n);
+            this->compress(false);
+        }
+    }
+
+    void finish() {
+        if (fMode == GPNGOptions::kStore) {
+            if (fFinal || !fStored.empty()) {
+                this->emitStored(fFinal);
+            }
+            return;
+        }
+        this->compress(true);
+        this->putSymbol(256);   // end of block
+        if (!fFinal) {
+            this->putBits(0, 3);    // an empty stored block, BFINAL clear...
+        }
+        if (fBitCount > 0) {
+            this->putBits(0, 8 - fBitCount);
+        }
+        if (!fFinal) {
+            static const uint8_t kEmpty[4] = { 0, 0, 0xFF, 0xFF };  // ...of length 0
+            fOut->insert(fOut->end(), kEmpty, kEmpty + 4);
+        }
+    }
+
+private:
+    static const size_t kMaxStored = 65535;
+    static const int kHashBits = 15;
+
+    const GPNGOptions::Compression fMode;
+    const bool                  fFinal;
+    const FixedCodes&           fCodes;
+    std::vector<uint8_t>*       fOut;
+    uint64_t                    fBits = 0;
+    int                         fBitCount = 0;
+
+    std::vector<uint8_t>        fStored;        // kStore: the pending stored block
+    std::vector<uint8_t>        fWindow;        // otherwise: the last 32K, then bytes to encode
+    size_t                      fPos = 0;       // next byte of fWindow to encode
+    std::vector<int32_t>        fHead;          // kFast: hash of 3 bytes -> last position
+
+    void putBits(uint32_t value, int count) {
+        fBits |= (uint64_t)value << fBitCount;
+        fBitCount += count;
+        while (fBitCount >= 8) {
+            fOut->push_back((uint8_t)fBits);
+            fBits >>= 8;
+            fBitCount -= 8;
+        }
+    }
+
+    void putSymbol(int symbol) {
+        this->putBits(fCodes.fLitCode[symbol], fCodes.fLitLength[symbol]);
+    }
+
+    void putMatch(int length, int distance) {
+        int ls = fCodes.fLengthSymbol[length];
+        this->putSymbol(257 + ls);
+        this->putBits(length - kLengthBase[ls], kLengthExtra[ls]);
+        int ds = fCodes.fDistSymbol[distance];
+        this->putBits(reverse_bits(ds, 5), 5);
+        this->putBits(distance - kDistBase[ds], kDistExtra[ds]);
+    }
+
+    void emitStored(bool last) {
+        uint8_t header[5];
+        header[0] = last ? 1 : 0;   // BFINAL, BTYPE 00, padded to the byte
+        uint16_t len = (uint16_t)fStored.size();
+        header[1] = len;
+        header[2] = len >> 8;
+        header[3] = ~len;
+        header[4] = (uint16_t)~len >> 8;
+        fOut->insert(fOut->end(), header, header + 5);
+        fOut->insert(fOut->end(), fStored.begin(), fStored.end());
+        fStored.clear();
+    }
+
+    int matchLength(size_t pos, size_t from, size_t end) const {
+        const uint8_t* a = fWindow.data() + pos;
+        const uint8_t* b = fWindow.data() + from;
+        int limit = (int)std::min((size_t)kMaxMatch, end - pos);
+        int n = 0;
+        while (n < limit && a[n] == b[n]) {
+            n += 1;
+        }
+        return n;
+    }
+
+    static uint32_t hash3(const uint8_t p[]) {
+        uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+        return (v * 2654435761u) >> (32 - kHashBits);
+    }
+
+    // Encodes fWindow from fPos, leaving a full match's worth unencoded unless this is the end,
+    // so a match is never cut short by a row that hasn't arrived yet.
+    void compress(bool final) {
+        const size_t end = fWindow.size();
+        const size_t stop = final ? end : (end > (size_t)kMaxMatch ? end - kMaxMatch : 0);
+        size_t pos = fPos;
+
+        while (pos < stop) {
+            int bestLength = 0, bestDistance = 0;
+            if (pos + kMinMatch <= end) {
+                if (fMode == GPNGOptions::kRLE) {
+                    // repeats of the byte before (runs after a filter), or of the pixel before
+                    for (int distance : { 1, 4 }) {
+                        if (pos >= (size_t)distance) {
+                            int length = this->matchLength(pos, pos - distance, end);
+                            if (length > bestLength) {
+                                bestLength = length;
+                                bestDistance = distance;
+                            }
+                        }
+                    }
+                } else {
+                    uint32_t h = hash3(&fWindow[pos]);
+                    int32_t candidate = fHead[h];
+                    fHead[h] = (int32_t)pos;
+                    if (candidate >= 0 && pos - candidate <= (size_t)kWindow) {
+                        bestLength = this->matchLength(pos, candidate, end);
+                        bestDistance = (int)(pos - candidate);
+                    }
+                }
+            }
+
+            if (bestLength >= kMinMatch) {
+                this->putMatch(bestLength, bestDistance);
+                if (fMode == GPNGOptions::kFast) {
+                    for (size_t i = pos + 1; i < pos + bestLength && i + kMinMatch <= end; ++i) {
+                        fHead[hash3(&fWindow[i])] = (int32_t)i;
+                    }
+                }
+                pos += bestLength;
+            } else {
+                this->putSymbol(fWindow[pos]);
+                pos += 1;
+            }
+        }
+        fPos = pos;
+
+        // keep just the window that matches can reach back into
+        if (fPos > 2 * (size_t)kWindow) {
+            size_t drop = fPos - kWindow;
+            fWindow.erase(fWindow.begin(), fWindow.begin() + drop);
+            fPos -= drop;
+            for (int32_t& head : fHead) {
+                head = head >= (int32_t)drop ? head - (int32_t)drop : -1;
+            }
+        }
+    }
+};
+
+// Unpremultiplies and filters the bitmap's rows in order, keeping the row before for the
+// filters that look up.
+class RowFilter {
+public:
+    RowFilter(const GBitmap& bitmap, GPNGOptions::Filter filter)
+        : fBitmap(bitmap), fFilter(filter), fSize(bitmap.width() * 4)
+        , fCur(fSize), fPrev(fSize, 0), fScratch(fSize + 1), fBest(fSize + 1) {}
+
+    // The filtered size of a row: its filter type byte, then 4 bytes per pixel.
+    size_t rowSize() const { return fSize + 1; }
+
+    // Start at row y, which means unpremultiplying the row above it (if any) to filter against.
+    void start(int y) {
+        if (y > 0) {
+            GPNGUnpremulRow(fBitmap.getAddr(0, y - 1), fBitmap.width(), fPrev.data());
+        } else {
+            std::fill(fPrev.begin(), fPrev.end(), 0);
+        }
+    }
+
+    // Returns the next row, filtered. Valid until the next call.
+    const uint8_t* next(int y) {
+        GPNGUnpremulRow(fBitmap.getAddr(0, y), fBitmap.width(), fCur.data());
+        const uint8_t* cur = fCur.data();
+        const uint8_t* prev = fPrev.data();
+        switch (fFilter) {
+            case GPNGOptions::kNone_Filter:  filter_row(0, cur, prev, fSize, fBest.data()); break;
+            case GPNGOptions::kSub_Filter:   filter_row(1, cur, prev, fSize, fBest.data()); break;
+            case GPNGOptions::kUp_Filter:    filter_row(2, cur, prev, fSize, fBest.data()); break;
+            case GPNGOptions::kPaeth_Filter: filter_row(4, cur, prev, fSize, fBest.data()); break;
+            case GPNGOptions::kAdaptive_Filter: {
+                int bestSum = filter_row(0, cur, prev, fSize, fBest.data());
+                for (int type = 1; type <= 4; ++type) {
+                    int sum = filter_row(type, cur, prev, fSize, fScratch.data());
+                    if (sum < bestSum) {
+                        bestSum = sum;
+                        std::swap(fBest, fScratch);
+                    }
+                }
+            } break;
+        }
+        std::swap(fCur, fPrev);
+        return fBest.data();
+    }
+
+private:
+    const GBitmap&              fBitmap;
+    const GPNGOptions::Filter   fFilter;
+    const int                   fSize;
+    std::vector<uint8_t>        fCur, fPrev, fScratch, fBest;
+};
+
+// Writes the PNG: header chunks, then the zlib stream split into IDAT chunks as it fills, then
+// IEND.
+class PNGStream {
+public:
+    explicit PNGStream(FILE* file) : fFile(file) {}
+
+    void begin(int width, int height) {
+        static const uint8_t kSignature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        this->write(kSignature, 8);
+
+        uint8_t ihdr[13];
+        put_be32(ihdr + 0, width);
+        put_be32(ihdr + 4, height);
+        ihdr[8] = 8;    // bits per channel
+        ihdr[9] = 6;    // RGBA
+        ihdr[10] = ihdr[11] = ihdr[12] = 0;
+        this->writeChunk("IHDR", ihdr, 13);
+
+        this->startChunk();
+        fChunk.push_back(0x78);     // deflate, 32K window
+        fChunk.push_back(0x01);     // fastest, and (0x7801 % 31) == 0
+    }
+
+    // Where compressed data goes: the current IDAT chunk. Call flush() after adding to it.
+    std::vector<uint8_t>* idat() { return &fChunk; }
+
+    void flush() {
+        if (fChunk.size() >= kChunkSize) {
+            this->endChunk();
+            this->startChunk();
+        }
+    }
+
+    bool finish(uint32_t adler) {
+        uint8_t trailer[4];
+        put_be32(trailer, adler);
+        fChunk.insert(fChunk.end(), trailer, trailer + 4);
+        this->endChunk();
+
+        this->writeChunk("IEND", nullptr, 0);
+        return fOK;
+    }
+
+private:
+    static const size_t kChunkSize = 1 << 16;
+
+    FILE*                   fFile;
+    bool                    fOK = true;
+    std::vector<uint8_t>    fChunk;     // "IDAT" followed by its data so far
+
+    static void put_be32(uint8_t dst[], uint32_t v) {
+        dst[0] = v >> 24;
+        dst[1] = v >> 16;
+        dst[2] = v >> 8;
+        dst[3] = v;
+    }
+
+    void write(const void* data, size_t n) {
+        if (fOK && n > 0 && fwrite(data, 1, n, fFile) != n) {
+            fOK = false;
+        }
+    }
+
+    void writeChunk(const char type[4], const uint8_t data[], size_t n) {
+        fChunk.assign(type, type + 4);
+        fChunk.insert(fChunk.end(), data, data + n);
+        this->endChunk();
+    }
+
+    void startChunk() {
+        fChunk.assign({ 'I', 'D', 'A', 'T' });
+    }
+
+    // fChunk holds the type and the data; the length and CRC wrap it.
+    void endChunk() {
+        uint8_t length[4], crc[4];
+        put_be32(length, (uint32_t)(fChunk.size() - 4));
+        put_be32(crc, lodepng_crc32(fChunk.data(), fChunk.size()));
+        this->write(length, 4);
+        this->write(fChunk.data(), fChunk.size());
+        this->write(crc, 4);
+    }
+};
+
+// A run of rows compressed on its own, primed with the 32K of filtered rows before it.
+struct Band {
+    int                     fTop, fBottom;
+    std::vector<uint8_t>    fData;
+    uint32_t                fAdler = 1;
+    size_t                  fLength = 0;
+};
+
+static void compress_band(const GBitmap& bitmap, const GPNGOptions& options, bool final,
+                          Band* band) {
+    RowFilter rows(bitmap, options.fFilter);
+    Deflater deflater(options.fCompression, final, &band->fData);
+
+    int y = band->fTop;
+    for (size_t primed = 0; y > 0 && primed < (size_t)kWindow; primed += rows.rowSize()) {
+        y -= 1;
+    }
+    rows.start(y);
+    for (; y < band->fTop; ++y) {
+        deflater.prime(rows.next(y), rows.rowSize());
+    }
+    for (; y < band->fBottom; ++y) {
+        const uint8_t* row = rows.next(y);
+        band->fAdler = update_adler(band->fAdler, row, rows.rowSize());
+        band->fLength += rows.rowSize();
+        deflater.add(row, rows.rowSize());
+    }
+    deflater.finish();
+}
+
+// Bands are about this many bytes of filtered rows: big enough that priming and the flush
+// between them cost little, small enough to keep every thread busy.
+static const size_t kBandBytes = 256 * 1024;
+
+static bool write_parallel(FILE* file, const GBitmap& bitmap, const GPNGOptions& options) {
+    const int height = bitmap.height();
+    const size_t rowSize = bitmap.width() * 4 + 1;
+    const int bandRows = std::max(1, (int)(kBandBytes / rowSize));
+
+    std::vector<Band> bands;
+    for (int top = 0; top < height; top += bandRows) {
+        bands.push_back({ top, std::min(top + bandRows, height) });
+    }
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i; (i = next++) < bands.size(); ) {
+            compress_band(bitmap, options, i + 1 == bands.size(), &bands[i]);
+        }
+    };
+    std::vector<std::thread> threads;
+    int extra = std::min(options.fThreads, (int)bands.size()) - 1;
+    for (int i = 0; i < extra; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    PNGStream stream(file);
+    stream.begin(bitmap.width(), height);
+    uint32_t adler = 1;
+    for (const Band& band : bands) {
+        std::vector<uint8_t>* idat = stream.idat();
+        idat->insert(idat->end(), band.fData.begin(), band.fData.end());
+        stream.flush();
+        adler = combine_adler(adler, band.fAdler, band.fLength);
+    }
+    return stream.finish(adler);
+}
+
+bool GPNGWriteStreamed(FILE* file, const GBitmap& bitmap, const GPNGOptions& options) {
+    assert(options.fCompression == GPNGOptions::kStore ||
+           options.fCompression == GPNGOptions::kRLE ||
+           options.fCompression == GPNGOptions::kFast);
+
+    if (options.fThreads > 1 && bitmap.height() > 0) {
+        return write_parallel(file, bitmap, options);
+    }
+
+    PNGStream stream(file);
+    stream.begin(bitmap.width(), bitmap.height());
+    Deflater deflater(options.fCompression, true, stream.idat());
+    RowFilter rows(bitmap, options.fFilter);
+    rows.start(0);
+    uint32_t adler = 1;
+    for (int y = 0; y < bitmap.height(); ++y) {
+        const uint8_t* row = rows.next(y);
+        adler = update_adler(adler, row, rows.rowSize());
+        deflater.add(row, rows.rowSize());
+        stream.flush();
+    }
+    deflater.finish();
+    return stream.finish(adler);
+}
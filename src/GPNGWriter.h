@@ -0,0 +1,24 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#ifndef GPNGWriter_DEFINED
+#define GPNGWriter_DEFINED
+
+#include "../include/GBitmap.h"
+#include <cstdio>
+
+/**
+ *  Unpremultiply a row of pixels into PNG's RGBA byte order (4 bytes per pixel).
+ */
+void GPNGUnpremulRow(const GPixel src[], int width, uint8_t dst[]);
+
+/**
+ *  Write the bitmap to the file as an 8-bit RGBA PNG, filtering and compressing one row at a
+ *  time. Only handles the streaming compressions (kStore, kRLE, kFast). With options.fThreads > 1
+ *  the rows are split into bands that are compressed in parallel, then written in order.
+ *  Return true on success.
+ */
+bool GPNGWriteStreamed(FILE*, const GBitmap&, const GPNGOptions&);
+
+#endif
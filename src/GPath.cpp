@@ -4,19 +4,29 @@
 
 #include "../include/GPath.h"
 #include "../include/GMatrix.h"
+#include "GPathPriv.h"
 
 GPath::GPath() {}
+GPath::GPath(const GPath& src) : fPts(src.fPts), fVbs(src.fVbs), fIsVolatile(src.fIsVolatile) {}
 GPath::~GPath() {}
 
 GPath& GPath::operator=(const GPath& src) {
     if (this != &src) {
+        this->invalidate();
         fPts = src.fPts;
         fVbs = src.fVbs;
+        fIsVolatile = src.fIsVolatile;
     }
     return *this;
 }
 
+void GPath::discardCache() {
+    fFlat.reset();
+    fDrawn = false;
+}
+
 void GPath::reset() {
+    this->invalidate();
     fPts.clear();
     fVbs.clear();
 }
@@ -47,6 +57,7 @@ void GPath::dump() const {
 
 void GPath::quadTo(GPoint p1, GPoint p2) {
     assert(fVbs.size() > 0);
+    this->invalidate();
     fPts.push_back(p1);
     fPts.push_back(p2);
     fVbs.push_back(kQuad);
@@ -54,6 +65,7 @@ void GPath::quadTo(GPoint p1, GPoint p2) {
 
 void GPath::cubicTo(GPoint p1, GPoint p2, GPoint p3) {
     assert(fVbs.size() > 0);
+    this->invalidate();
     fPts.push_back(p1);
     fPts.push_back(p2);
     fPts.push_back(p3);
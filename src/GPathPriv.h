@@ -0,0 +1,54 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#ifndef GPathPriv_DEFINED
+#define GPathPriv_DEFINED
+
+#include "../include/GPath.h"
+
+/**
+ *  The path's edges flattened into line segments under the scale/skew part of a matrix. The
+ *  canvas reuses it for later draws whose scale/skew match. The translate is not part of the
+ *  key: it is added back as the segments are turned into edges.
+ */
+struct GPathFlatCache {
+    float               fScaleSkew[4];  // matrix entries [0..3] the points were mapped by
+    float               fExtent;        // largest |x| or |y| of the original points
+    GRect               fBounds;        // bounds of fPts
+    std::vector<GPoint> fPts;           // one polyline per edge verb...
+    std::vector<int>    fEnds;          // ...ending (exclusive) at each of these indices
+    std::vector<GRect>  fRunBounds;     // ...and with these bounds
+};
+
+/**
+ *  The canvas's access to the cache it keeps in a GPath.
+ */
+class GPathPriv {
+public:
+    static GPathFlatCache* FlatCache(const GPath& path) { return path.fFlat.get(); }
+
+    static GPathFlatCache* MakeFlatCache(const GPath& path) {
+        if (!path.fFlat) {
+            path.fFlat.reset(new GPathFlatCache);
+        }
+        return path.fFlat.get();
+    }
+
+    /**
+     *  Note a draw of the path under ctm that its cache couldn't serve. Return true if the last
+     *  such draw had the same scale/skew, so caching is likely to pay off; a path drawn just once
+     *  is never worth flattening into a cache.
+     */
+    static bool RepeatsScaleSkew(const GPath& path, const GMatrix& ctm) {
+        bool repeats = path.fDrawn;
+        for (int i = 0; i < 4; ++i) {
+            repeats = repeats && path.fLastScaleSkew[i] == ctm[i];
+            path.fLastScaleSkew[i] = ctm[i];
+        }
+        path.fDrawn = true;
+        return repeats;
+    }
+};
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#include "../include/GSurfacePool.h"
+
+#include <cstdlib>
+#include <cstring>
+
+static GPixel* aligned_pixels(int w, int h, size_t rb) {
+    if (w <= 0 || h <= 0) {
+        return nullptr;
+    }
+    // rb is a multiple of the alignment, so the size is too, as aligned_alloc requires
+    assert(rb % kGSurfaceAlignment == 0);
+    return (GPixel*)aligned_alloc(kGSurfaceAlignment, h * rb);
+}
+
+static uint64_t size_key(int w, int h) {
+    return ((uint64_t)w << 32) | (uint32_t)h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+GOwnedBitmap::GOwnedBitmap(GOwnedBitmap&& src) : fBitmap(src.fBitmap), fPool(src.fPool) {
+    src.fBitmap.reset();
+    src.fPool = nullptr;
+}
+
+GOwnedBitmap& GOwnedBitmap::operator=(GOwnedBitmap&& src) {
+    if (this != &src) {
+        this->reset();
+        fBitmap = src.fBitmap;
+        fPool = src.fPool;
+        src.fBitmap.reset();
+        src.fPool = nullptr;
+    }
+    return *this;
+}
+
+GOwnedBitmap GOwnedBitmap::Alloc(int w, int h) {
+    assert(w >= 0 && h >= 0);
+    size_t rb = GBitmap::PreferredRowBytes(w);
+    GPixel* pixels = aligned_pixels(w, h, rb);
+    if (pixels) {
+        memset(pixels, 0, h * rb);
+    }
+
+    GOwnedBitmap owned;
+    owned.fBitmap.reset(w, h, rb, pixels, GBitmap::kNo_IsOpaque);
+    return owned;
+}
+
+void GOwnedBitmap::reset() {
+    if (fPool) {
+        fPool->release(&fBitmap);
+    } else {
+        free(fBitmap.pixels());
+    }
+    fBitmap.reset();
+    fPool = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+GSurfacePool::~GSurfacePool() {
+    assert(fLive == 0);
+    this->purge();
+}
+
+GOwnedBitmap GSurfacePool::alloc(int w, int h, bool zero) {
+    assert(w >= 0 && h >= 0);
+    size_t rb = GBitmap::PreferredRowBytes(w);
+
+    GPixel* pixels = nullptr;
+    auto iter = fFree.find(size_key(w, h));
+    if (iter != fFree.end() && !iter->second.empty()) {
+        pixels = iter->second.back();
+        iter->second.pop_back();
+    } else {
+        pixels = aligned_pixels(w, h, rb);
+    }
+    if (pixels && zero) {
+        memset(pixels, 0, h * rb);
+    }
+
+    GOwnedBitmap owned;
+    owned.fBitmap.reset(w, h, rb, pixels, GBitmap::kNo_IsOpaque);
+    if (pixels) {
+        owned.fPool = this;
+        fLive += 1;
+    }
+    return owned;
+}
+
+void GSurfacePool::release(GBitmap* bitmap) {
+    assert(fLive > 0);
+    fLive -= 1;
+
+    std::vector<GPixel*>& free_list = fFree[size_key(bitmap->width(), bitmap->height())];
+    if ((int)free_list.size() < fMaxFreePerSize) {
+        free_list.push_back(bitmap->pixels());
+    } else {
+        free(bitmap->pixels());
+    }
+}
+
+void GSurfacePool::purge() {
+    for (auto& entry : fFree) {
+        for (GPixel* pixels : entry.second) {
+            free(pixels);
+        }
+    }
+    fFree.clear();
+}
@@ -0,0 +1,430 @@
+/*
+ *  Copyright 2024 Gordon Kim
+ */
+
+#include "include/GStroke.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// how far (in device pixels) the flattened stroke may stray from the true outline
+const float kStrokeTolerance = 0.25f;
+const int kMaxStrokeSegments = 1024;
+// a contour that would repeat its dash pattern more often than this is stroked solid
+const float kMaxDashPatterns = 1 << 14;
+
+struct StrokeVertex {
+  GPoint p;
+  bool corner;  // false for points that only come from flattening a curve
+};
+
+typedef vector<StrokeVertex> Polyline;
+
+static void appendVertex(Polyline& poly, GPoint p, bool corner) {
+  if(!poly.empty() && poly.back().p == p) {
+    poly.back().corner = poly.back().corner || corner;
+    return;
+  }
+  poly.push_back({p, corner});
+}
+
+static float cross(GVector a, GVector b) { return a.x*b.y - a.y*b.x; }
+static float dot(GVector a, GVector b) { return a.x*b.x + a.y*b.y; }
+
+static GVector rotate(GVector v, float c, float s) {
+  return { v.x*c - v.y*s, v.x*s + v.y*c };
+}
+
+// the control polygon turns at least as far as the curve's tangent does
+static float controlTurn(const GPoint pts[], int count) {
+  float turn = 0;
+  GVector prev = {0, 0};
+  for(int i = 1; i < count; i++) {
+    GVector leg = pts[i] - pts[i - 1];
+    if(leg.x == 0 && leg.y == 0) continue;
+    if(prev.x != 0 || prev.y != 0) {
+      turn += atan2f(fabsf(cross(prev, leg)), dot(prev, leg));
+    }
+    prev = leg;
+  }
+  return turn;
+}
+
+static GPoint evalQuad(const GPoint pts[3], float t) {
+  float s = 1 - t;
+  return s*s*pts[0] + 2*s*t*pts[1] + t*t*pts[2];
+}
+
+static GPoint evalCubic(const GPoint pts[4], float t) {
+  float s = 1 - t;
+  return s*s*s*pts[0] + 3*s*s*t*pts[1] + 3*s*t*t*pts[2] + t*t*t*pts[3];
+}
+
+class Stroker {
+public:
+  Stroker(const GStroke& stroke, GPath& dst) : stroke(stroke), dst(dst) {
+    radius = stroke.fWidth * 0.5f;
+    float scale = stroke.fResScale > 0 ? stroke.fResScale : 1;
+    tolerance = kStrokeTolerance / scale;
+
+    // an arc of this angle strays from its chord by at most the tolerance
+    float devRadius = radius * scale;
+    arcStep = (float)M_PI / 2;
+    if(devRadius > kStrokeTolerance) {
+      arcStep = min(arcStep, 2 * acosf(1 - kStrokeTolerance / devRadius));
+    }
+
+    for(float d : stroke.fDashes) {
+      if(d < 0) {
+        dashes.clear();
+        break;
+      }
+      dashes.push_back(d);
+      dashLength += d;
+    }
+    if(dashLength < tolerance) {
+      // all zero, or a pattern too fine to show (and too fine for the walk to step through)
+      dashes.clear();
+    } else if(dashes.size() & 1) {
+      // an odd list repeats to make the on/off pairs line up (as in SVG)
+      dashes.insert(dashes.end(), dashes.begin(), dashes.end());
+      dashLength *= 2;
+    }
+    for(float d : dashes) {
+      maxDash = max(maxDash, d);
+    }
+  }
+
+  void strokePath(const GPath& src) {
+    Polyline& poly = contour;
+    poly.clear();
+
+    GPoint pts[GPath::kMaxNextPoints];
+    GPath::Iter iter(src);
+    while(auto v = iter.next(pts)) {
+      switch(v.value()) {
+        case GPath::kMove:
+          this->strokeContour(poly);
+          poly.clear();
+          appendVertex(poly, pts[0], true);
+          break;
+        case GPath::kLine:
+          appendVertex(poly, pts[1], true);
+          break;
+        case GPath::kQuad: {
+          GPoint A = pts[0] - 2*pts[1] + pts[2];
+          int n = this->curveSegments(sqrtf(A.length() / (4 * tolerance)), controlTurn(pts, 3));
+          for(int i = 1; i < n; i++) {
+            appendVertex(poly, evalQuad(pts, (float)i / n), false);
+          }
+          appendVertex(poly, pts[2], true);
+          break;
+        }
+        case GPath::kCubic: {
+          GPoint D0 = pts[0] - 2*pts[1] + pts[2];
+          GPoint D1 = pts[1] - 2*pts[2] + pts[3];
+          float M = max(D0.length(), D1.length());
+          int n = this->curveSegments(sqrtf(3 * M / (4 * tolerance)), controlTurn(pts, 4));
+          for(int i = 1; i < n; i++) {
+            appendVertex(poly, evalCubic(pts, (float)i / n), false);
+          }
+          appendVertex(poly, pts[3], true);
+          break;
+        }
+      }
+    }
+    this->strokeContour(poly);
+  }
+
+private:
+  const GStroke& stroke;
+  GPath& dst;
+  float radius;
+  float tolerance;    // in path units
+  float arcStep;      // largest angle one flat piece of an offset arc may turn through
+  vector<float> dashes;
+  float dashLength = 0;
+  float maxDash = 0;
+
+  // scratch storage reused across contours
+  Polyline contour, dash, head;
+  vector<GVector> units;
+  vector<GPoint> fan;
+
+  // enough pieces to follow the curve itself, and to keep its offset (turned through the
+  // same angle, but at distance radius) within tolerance
+  int curveSegments(float flatSegments, float turn) {
+    float n = max(flatSegments, turn / arcStep);
+    return (int)min(max(ceilf(n), 1.0f), (float)kMaxStrokeSegments);
+  }
+
+  // adds the closed polygon in fan[] winding clockwise, whichever way it was generated
+  void addFan() {
+    const GPoint* pts = fan.data();
+    int count = (int)fan.size();
+    float area = 0;
+    for(int i = 1; i < count - 1; i++) {
+      area += cross(pts[i] - pts[0], pts[i + 1] - pts[0]);
+    }
+    if(area > 0) {
+      dst.addPolygon(pts, count);
+    } else if(area < 0) {
+      dst.moveTo(pts[0]);
+      for(int i = count - 1; i > 0; i--) {
+        dst.lineTo(pts[i]);
+      }
+    }
+  }
+
+  // appends the arc of radius |v| around center, starting at center + v and turning by angle
+  void appendArc(GPoint center, GVector v, float angle) {
+    int steps = max(1, (int)ceilf(fabsf(angle) / arcStep));
+    float c = cosf(angle / steps);
+    float s = sinf(angle / steps);
+    fan.push_back(center + v);
+    for(int i = 1; i <= steps; i++) {
+      v = rotate(v, c, s);
+      fan.push_back(center + v);
+    }
+  }
+
+  void strokeContour(Polyline& poly) {
+    if(poly.empty() || radius <= 0) return;
+
+    bool closed = stroke.fClosed;
+    if(poly.size() > 1 && poly.front().p == poly.back().p) {
+      closed = true;
+      poly.pop_back();
+    }
+
+    if(dashes.empty() || !this->dashable(poly, closed)) {
+      this->strokePolyline(poly, closed);
+    } else {
+      this->dashContour(poly, closed);
+    }
+  }
+
+  // Dashing a contour many times the pattern's length would make a sub-path per dash, so those
+  // are stroked solid. So are contours whose longest interval is too short to move a float
+  // position along them, where the walk would never reach the end.
+  bool dashable(const Polyline& poly, bool closed) const {
+    float length = 0;
+    for(size_t i = 0; i + 1 < poly.size(); i++) {
+      length += (poly[i + 1].p - poly[i].p).length();
+    }
+    if(closed && poly.size() > 1) {
+      length += (poly.front().p - poly.back().p).length();
+    }
+    return length <= kMaxDashPatterns * dashLength && maxDash >= length * (1.0f / (1 << 20));
+  }
+
+  void dashContour(Polyline& poly, bool closed) {
+    if(closed) {
+      poly.push_back(poly.front());
+    }
+
+    int count = (int)dashes.size();
+    float phase = fmodf(stroke.fDashPhase, dashLength);
+    if(phase < 0) {
+      phase += dashLength;
+    }
+    int idx = 0;
+    while(phase > 0 && phase >= dashes[idx]) {
+      phase -= dashes[idx];
+      idx = (idx + 1) % count;
+    }
+    float left = dashes[idx] - phase;
+    bool on = (idx & 1) == 0;
+
+    // on a closed contour a dash running through the start point is stroked as one piece:
+    // hold the first dash back until we know how the last one ends
+    bool keepHead = closed && on;
+    bool haveHead = false;
+    dash.clear();
+    head.clear();
+
+    for(size_t i = 0; i + 1 < poly.size(); i++) {
+      GPoint a = poly[i].p;
+      GPoint b = poly[i + 1].p;
+      float len = (b - a).length();
+      GVector u = (b - a) * (1 / len);
+      float pos = 0;
+
+      while(true) {
+        if(on && dash.empty()) {
+          appendVertex(dash, a + u*pos, pos == 0 && poly[i].corner);
+        }
+        bool segDone = left >= len - pos;
+        if(segDone) {
+          left -= len - pos;
+          pos = len;
+        } else {
+          pos += left;
+          left = 0;
+        }
+        if(on) {
+          if(segDone) {
+            appendVertex(dash, b, poly[i + 1].corner);
+          } else {
+            appendVertex(dash, a + u*pos, false);
+          }
+        }
+
+        if(left <= 0) {
+          if(on) {
+            if(keepHead && !haveHead) {
+              head.swap(dash);
+              haveHead = true;
+            } else {
+              this->strokePolyline(dash, false);
+            }
+            dash.clear();
+          }
+          idx = (idx + 1) % count;
+          left = dashes[idx];
+          on = !on;
+        }
+        if(segDone) break;
+      }
+    }
+
+    if(keepHead && !haveHead) {
+      // never switched off: the whole contour is one dash
+      dash.pop_back();
+      this->strokePolyline(dash, true);
+    } else if(haveHead && !dash.empty()) {
+      for(const StrokeVertex& v : head) {
+        appendVertex(dash, v.p, v.corner);
+      }
+      this->strokePolyline(dash, false);
+    } else {
+      if(haveHead) {
+        this->strokePolyline(head, false);
+      }
+      if(!dash.empty()) {
+        this->strokePolyline(dash, false);
+      }
+    }
+  }
+
+  void strokePolyline(const Polyline& poly, bool closed) {
+    int n = (int)poly.size();
+    if(n == 1) {
+      this->strokePoint(poly[0].p);
+      return;
+    }
+
+    int segs = closed ? n : n - 1;
+    units.resize(segs);
+    for(int i = 0; i < segs; i++) {
+      GPoint a = poly[i].p;
+      GPoint b = poly[(i + 1) % n].p;
+      GVector u = (b - a) * (1 / (b - a).length());
+      GVector norm = GVector{u.y, -u.x} * radius;
+      units[i] = u;
+
+      // a+norm -> b+norm -> b-norm -> a-norm is always clockwise
+      dst.moveTo(a + norm);
+      dst.lineTo(b + norm);
+      dst.lineTo(b - norm);
+      dst.lineTo(a - norm);
+    }
+
+    if(closed) {
+      for(int i = 0; i < n; i++) {
+        this->join(poly[i], units[(i + segs - 1) % segs], units[i]);
+      }
+    } else {
+      for(int i = 1; i < n - 1; i++) {
+        this->join(poly[i], units[i - 1], units[i]);
+      }
+      this->cap(poly[0].p, GVector{0, 0} - units[0]);
+      this->cap(poly[n - 1].p, units[segs - 1]);
+    }
+  }
+
+  // fills the wedge on the outside of the turn from u0 to u1; inside, the segments overlap
+  void join(const StrokeVertex& vertex, GVector u0, GVector u1) {
+    float c = cross(u0, u1);
+    float d = dot(u0, u1);
+    if(c == 0 && d > 0) return;
+
+    GPoint p = vertex.p;
+    float side = c >= 0 ? radius : -radius;
+    GVector n0 = GVector{u0.y, -u0.x} * side;
+    GVector n1 = GVector{u1.y, -u1.x} * side;
+
+    // points inside a flattened curve only need their (tiny) gaps filled
+    GStroke::Join join = vertex.corner ? stroke.fJoin : GStroke::kBevel_Join;
+
+    fan.clear();
+    fan.push_back(p);
+    switch(join) {
+      case GStroke::kMiter_Join: {
+        GVector mid = (n0 + n1) * 0.5f;
+        float mid2 = dot(mid, mid);
+        fan.push_back(p + n0);
+        // the miter is radius/|mid| times the stroke width
+        if(radius * radius <= stroke.fMiterLimit * stroke.fMiterLimit * mid2) {
+          fan.push_back(p + mid * (radius * radius / mid2));
+        }
+        fan.push_back(p + n1);
+        break;
+      }
+      case GStroke::kRound_Join: {
+        float turn = atan2f(fabsf(c), d);
+        this->appendArc(p, n0, side > 0 ? turn : -turn);
+        break;
+      }
+      case GStroke::kBevel_Join:
+        fan.push_back(p + n0);
+        fan.push_back(p + n1);
+        break;
+    }
+    this->addFan();
+  }
+
+  // u points away from the stroke
+  void cap(GPoint p, GVector u) {
+    GVector norm = GVector{u.y, -u.x} * radius;
+    switch(stroke.fCap) {
+      case GStroke::kButt_Cap:
+        return;
+      case GStroke::kRound_Cap:
+        fan.clear();
+        this->appendArc(p, norm, (float)M_PI);
+        break;
+      case GStroke::kSquare_Cap:
+        fan.assign({ p + norm, p + norm + u*radius, p - norm + u*radius, p - norm });
+        break;
+    }
+    this->addFan();
+  }
+
+  // a zero-length contour only shows up through its caps
+  void strokePoint(GPoint p) {
+    switch(stroke.fCap) {
+      case GStroke::kButt_Cap:
+        return;
+      case GStroke::kRound_Cap:
+        fan.clear();
+        this->appendArc(p, {radius, 0}, 2 * (float)M_PI);
+        fan.pop_back();
+        break;
+      case GStroke::kSquare_Cap:
+        fan.assign({ p + GVector{-radius, -radius}, p + GVector{radius, -radius},
+                     p + GVector{radius, radius}, p + GVector{-radius, radius} });
+        break;
+    }
+    this->addFan();
+  }
+};
+
+GPath GStrokePath(const GPath& src, const GStroke& stroke) {
+  GPath dst;
+  Stroker stroker(stroke, dst);
+  stroker.strokePath(src);
+  return dst;
+}